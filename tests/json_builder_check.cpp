@@ -0,0 +1,94 @@
+/*
+ * json_builder_check.cpp
+ *
+ *  json::Builder allocation check: building typical answer dict must do exactly the allocations
+ *  done by filling the same json::Dict by hand (map nodes and non-SSO strings), builder itself
+ *  allocates nothing. Previous builder with heap-allocated states did 27 allocations for this dict.
+ *
+ *  build from transport-catalogue directory:
+ *  g++ -std=c++17 -O2 -I. json.cpp json_builder.cpp ../tests/json_builder_check.cpp
+ */
+
+#include "json.h"
+#include "json_builder.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+using namespace std::literals;
+
+namespace {
+
+size_t allocations = 0;
+
+json::Node BuildAnswer(int id) {
+    return json::Builder { }.StartDict()
+            .Key("request_id"s).Value(id)
+            .Key("curvature"s).Value(1.36124)
+            .Key("route_length"s).Value(5950)
+            .Key("stop_count"s).Value(6)
+            .Key("unique_stop_count"s).Value(5)
+            .EndDict().Build();
+}
+
+json::Node FillAnswer(int id) {
+    json::Dict dict;
+    dict.emplace("request_id"s, id);
+    dict.emplace("curvature"s, 1.36124);
+    dict.emplace("route_length"s, 5950);
+    dict.emplace("stop_count"s, 6);
+    dict.emplace("unique_stop_count"s, 5);
+    return json::Node(std::move(dict));
+}
+
+template<typename Function>
+size_t CountAllocations(Function function) {
+    const size_t before = allocations;
+    json::Node node = function(1);
+    return allocations - before;
+}
+
+template<typename Function>
+double MeasureNs(Function function) {
+    constexpr int ITERATIONS = 200000;
+    const auto start = std::chrono::steady_clock::now();
+    size_t size = 0;
+    for (int i = 0; i < ITERATIONS; ++i) {
+        size += function(i).AsDict().size();
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return size ? elapsed.count() / ITERATIONS : 0;
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+int main() {
+    if (BuildAnswer(1) != FillAnswer(1)) {
+        std::cerr << "builder: dict differs from filled dict"sv << std::endl;
+        return 1;
+    }
+    const size_t built = CountAllocations(BuildAnswer);
+    const size_t filled = CountAllocations(FillAnswer);
+    std::cerr << "builder: "sv << built << " allocations, "sv << MeasureNs(BuildAnswer) << " ns; filled dict: "sv
+            << filled << " allocations, "sv << MeasureNs(FillAnswer) << " ns"sv << std::endl;
+    return built == filled ? 0 : 1;
+}
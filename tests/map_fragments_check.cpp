@@ -0,0 +1,115 @@
+/*
+ * map_fragments_check.cpp
+ *
+ *  Incremental map rendering check: map rendered by renderer after catalog changes
+ *  must be the same as map rendered from scratch by new renderer,
+ *  and fragments of the first map must be reused by the map of the first change.
+ *
+ *  build from transport-catalogue directory:
+ *  g++ -std=c++17 -O2 -pthread -I. $(ls *.cpp | grep -vx main.cpp) ../tests/map_fragments_check.cpp
+ */
+
+#include "json.h"
+#include "map_renderer.h"
+#include "request_handler.h"
+#include "transport_catalogue.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace std::literals;
+
+namespace {
+
+tc::renderer::Settings MakeSettings() {
+    tc::renderer::Settings settings;
+    settings.width = 600;
+    settings.height = 400;
+    settings.padding = 50;
+    settings.stop_radius = 5;
+    settings.line_width = 14;
+    settings.bus_label_font_size = 20;
+    settings.bus_label_offset = { 7, 15 };
+    settings.stop_label_font_size = 18;
+    settings.stop_label_offset = { 7, -3 };
+    settings.underlayer_color = svg::Rgba { 255, 255, 255, 0.85 };
+    settings.underlayer_width = 3;
+    settings.color_palette = { "green"s, svg::Rgb { 255, 160, 0 }, "red"s };
+    return settings;
+}
+
+void AddBus(tc::TransportCatalogue &catalog, const std::string &name, tc::BusType type,
+        std::initializer_list<std::string_view> stops) {
+    tc::Bus bus(name, type);
+    for (const auto stop : stops) {
+        bus.AddBusStop(catalog.GetBusStop(stop));
+    }
+    catalog.AddBus(std::move(bus));
+}
+
+std::string Render(const tc::handler::RequestHandler &handler, const tc::TransportCatalogue &catalog,
+        tc::renderer::Map &renderer) {
+    std::ostringstream out;
+    handler.RenderBusRoutesMap(catalog, renderer, out);
+    return std::move(out).str();
+}
+
+// fragments of handled maps reused from previous maps
+int GetReusedFragments(const tc::handler::RequestHandler &handler, const tc::TransportCatalogue &catalog,
+        tc::renderer::Map &renderer) {
+    json::Array requests { json::Dict { { "id"s, 1 }, { "type"s, "Stats"s } } };
+    const auto answers = handler.HandleQueries(catalog, requests, renderer);
+    return answers.GetRoot().AsArray().front().AsDict().at("map_cache"s).AsDict().at("fragments_reused"s).AsInt();
+}
+
+// compare map of long living renderer with map of new renderer
+bool Check(const std::string &step, const tc::handler::RequestHandler &handler,
+        const tc::TransportCatalogue &catalog, tc::renderer::Map &renderer) {
+    const std::string incremental = Render(handler, catalog, renderer);
+    tc::renderer::Map fresh;
+    fresh.SetSettings(MakeSettings());
+    if (incremental != Render(handler, catalog, fresh)) {
+        std::cerr << step << ": incremental map differs from full map"sv << std::endl;
+        return false;
+    }
+    std::cerr << step << ": ok"sv << std::endl;
+    return true;
+}
+
+} // namespace
+
+int main() {
+    tc::TransportCatalogue catalog;
+    catalog.AddBusStop(tc::BusStop("Morskoy vokzal"s, { 43.581969, 39.719848 }));
+    catalog.AddBusStop(tc::BusStop("Rivyerskiy most"s, { 43.587795, 39.716901 }));
+    catalog.AddBusStop(tc::BusStop("Elektroseti"s, { 43.598701, 39.730623 }));
+    catalog.AddBusStop(tc::BusStop("Ulitsa Dokuchaeva"s, { 43.585586, 39.733879 }));
+    catalog.AddBusStop(tc::BusStop("Ulitsa Lizy Chaykinoy"s, { 43.590317, 39.746833 }));
+    AddBus(catalog, "114"s, tc::BusType::LINEAR, { "Morskoy vokzal"sv, "Rivyerskiy most"sv });
+    AddBus(catalog, "14"s, tc::BusType::CIRCULAR, { "Ulitsa Lizy Chaykinoy"sv, "Elektroseti"sv,
+            "Ulitsa Dokuchaeva"sv, "Ulitsa Lizy Chaykinoy"sv });
+
+    tc::handler::RequestHandler handler(2);
+    tc::renderer::Map renderer;
+    renderer.SetSettings(MakeSettings());
+
+    bool ok = Check("first map"s, handler, catalog, renderer);
+    // bus sorted first shifts palette colors of all buses, stops of the first map are reused
+    AddBus(catalog, "0"s, tc::BusType::LINEAR, { "Elektroseti"sv, "Morskoy vokzal"sv });
+    ok = Check("palette shift"s, handler, catalog, renderer) && ok;
+    if (GetReusedFragments(handler, catalog, renderer) == 0) {
+        std::cerr << "palette shift: fragments of the first map are not reused"sv << std::endl;
+        ok = false;
+    }
+    // bus sorted last keeps colors of other buses, their fragments are reused
+    AddBus(catalog, "zzz"s, tc::BusType::CIRCULAR, { "Rivyerskiy most"sv, "Ulitsa Dokuchaeva"sv,
+            "Rivyerskiy most"sv });
+    ok = Check("bus added last"s, handler, catalog, renderer) && ok;
+    // palette shifts back to colors of fragments rendered two maps ago
+    AddBus(catalog, "00"s, tc::BusType::LINEAR, { "Ulitsa Dokuchaeva"sv, "Elektroseti"sv });
+    AddBus(catalog, "000"s, tc::BusType::LINEAR, { "Morskoy vokzal"sv, "Ulitsa Lizy Chaykinoy"sv });
+    ok = Check("palette cycle"s, handler, catalog, renderer) && ok;
+
+    return ok ? 0 : 1;
+}
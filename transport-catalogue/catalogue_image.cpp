@@ -0,0 +1,222 @@
+/*
+ * catalogue_image.cpp
+ *
+ *  Position independent catalog image and shared memory segments
+ */
+
+#include "catalogue_image.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std::literals;
+
+namespace tc {
+
+// image format signature and version
+static const char IMAGE_MAGIC[8] = { 'T', 'C', 'I', 'M', 'G', '0', '0', '1' };
+
+std::string CatalogueImage::Build(const TransportCatalogue &catalog, const std::string *map) {
+    const auto bus_names = catalog.GetSortedBusNames();
+    const auto stop_names = catalog.GetSortedBusStopNames();
+
+    std::unordered_map<std::string_view, uint64_t> bus_index;
+    for (size_t i = 0; i < bus_names.size(); ++i) {
+        bus_index[bus_names[i]] = i;
+    }
+
+    // records are built first, strings are appended after fixed size tables
+    std::vector<BusRecord> buses;
+    buses.reserve(bus_names.size());
+    std::vector<StopRecord> stops;
+    stops.reserve(stop_names.size());
+    std::vector<uint64_t> stop_buses;
+    std::string strings;
+    auto add_string = [&strings](std::string_view str) {
+        StringRef ref { strings.size(), str.size() };
+        strings += str;
+        return ref;
+    };
+
+    for (auto name : bus_names) {
+        auto result = catalog.ProcessBusQuery(name);
+        buses.push_back( { add_string(name), result.stops, result.unique_stops, result.length, result.curvature });
+    }
+    for (auto name : stop_names) {
+        auto result = catalog.ProcessBusStopQuery(name);
+        stops.push_back( { add_string(name), stop_buses.size(), result.buses_names.size() });
+        for (auto bus_name : result.buses_names) {
+            stop_buses.push_back(bus_index.at(bus_name));
+        }
+    }
+
+    Header header { };
+    std::memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    header.buses_count = buses.size();
+    header.buses_offset = sizeof(Header);
+    header.stops_count = stops.size();
+    header.stops_offset = header.buses_offset + buses.size() * sizeof(BusRecord);
+    header.stop_buses_offset = header.stops_offset + stops.size() * sizeof(StopRecord);
+    const uint64_t strings_offset = header.stop_buses_offset + stop_buses.size() * sizeof(uint64_t);
+    if (map != nullptr) {
+        header.has_map = 1;
+        header.map = add_string(*map);
+    }
+    header.size = strings_offset + strings.size();
+
+    // string offsets become image offsets
+    for (auto &bus : buses) {
+        bus.name.offset += strings_offset;
+    }
+    for (auto &stop : stops) {
+        stop.name.offset += strings_offset;
+    }
+    header.map.offset += strings_offset;
+
+    std::string image;
+    image.reserve(header.size);
+    image.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    image.append(reinterpret_cast<const char*>(buses.data()), buses.size() * sizeof(BusRecord));
+    image.append(reinterpret_cast<const char*>(stops.data()), stops.size() * sizeof(StopRecord));
+    image.append(reinterpret_cast<const char*>(stop_buses.data()), stop_buses.size() * sizeof(uint64_t));
+    image += strings;
+    return image;
+}
+
+CatalogueImage::CatalogueImage(const char *data, size_t size) :
+        data_(data), header_(reinterpret_cast<const Header*>(data)) {
+    if (size < sizeof(Header) || std::memcmp(header_->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0
+            || header_->size > size) {
+        throw std::invalid_argument("invalid catalogue image"s);
+    }
+}
+
+size_t CatalogueImage::GetSize() const {
+    return header_->size;
+}
+
+size_t CatalogueImage::GetBusesCount() const {
+    return header_->buses_count;
+}
+
+size_t CatalogueImage::GetBusStopsCount() const {
+    return header_->stops_count;
+}
+
+std::string_view CatalogueImage::GetString(StringRef ref) const {
+    return {data_ + ref.offset, ref.size};
+}
+
+template<typename Record>
+const Record* CatalogueImage::Find(const Record *records, size_t count, std::string_view name) const {
+    auto end = records + count;
+    auto found = std::lower_bound(records, end, name, [this](const Record &record, std::string_view name) {
+        return GetString(record.name) < name;
+    });
+    return found != end && GetString(found->name) == name ? found : nullptr;
+}
+
+std::optional<CatalogueImage::BusInfo> CatalogueImage::FindBus(std::string_view name) const {
+    const auto *buses = reinterpret_cast<const BusRecord*>(data_ + header_->buses_offset);
+    const auto *bus = Find(buses, header_->buses_count, name);
+    if (bus == nullptr) {
+        return std::nullopt;
+    }
+    return BusInfo { GetString(bus->name), bus->stops, bus->unique_stops, bus->length, bus->curvature };
+}
+
+std::optional<std::vector<std::string_view>> CatalogueImage::FindBusStop(std::string_view name) const {
+    const auto *stops = reinterpret_cast<const StopRecord*>(data_ + header_->stops_offset);
+    const auto *stop = Find(stops, header_->stops_count, name);
+    if (stop == nullptr) {
+        return std::nullopt;
+    }
+    const auto *buses = reinterpret_cast<const BusRecord*>(data_ + header_->buses_offset);
+    const auto *stop_buses = reinterpret_cast<const uint64_t*>(data_ + header_->stop_buses_offset);
+    std::vector<std::string_view> result;
+    result.reserve(stop->buses_count);
+    for (uint64_t i = stop->buses_begin; i < stop->buses_begin + stop->buses_count; ++i) {
+        result.push_back(GetString(buses[stop_buses[i]].name));
+    }
+    return result;
+}
+
+std::optional<std::string_view> CatalogueImage::GetMap() const {
+    if (!header_->has_map) {
+        return std::nullopt;
+    }
+    return GetString(header_->map);
+}
+
+SharedMemory::SharedMemory(void *address, size_t size) :
+        address_(address), size_(size) {
+}
+
+SharedMemory::SharedMemory(SharedMemory &&other) noexcept :
+        address_(other.address_), size_(other.size_) {
+    other.address_ = nullptr;
+    other.size_ = 0;
+}
+
+SharedMemory::~SharedMemory() {
+    if (address_ != nullptr) {
+        munmap(address_, size_);
+    }
+}
+
+SharedMemory SharedMemory::Create(const std::string &name, std::string_view data) {
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("shared memory create error: "s + std::strerror(errno));
+    }
+    // empty mapping is not allowed
+    size_t size = std::max<size_t>(1, data.size());
+    if (ftruncate(fd, size) < 0) {
+        int error = errno;
+        close(fd);
+        shm_unlink(name.c_str());
+        throw std::runtime_error("shared memory resize error: "s + std::strerror(error));
+    }
+    void *address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw std::runtime_error("shared memory map error: "s + std::strerror(errno));
+    }
+    std::memcpy(address, data.data(), data.size());
+    // segment is read-only after creation
+    mprotect(address, size, PROT_READ);
+    return SharedMemory(address, size);
+}
+
+SharedMemory SharedMemory::Open(const std::string &name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        throw std::runtime_error("shared memory open error: "s + std::strerror(errno));
+    }
+    struct stat info { };
+    if (fstat(fd, &info) < 0 || info.st_size <= 0) {
+        close(fd);
+        throw std::runtime_error("shared memory segment is empty"s);
+    }
+    void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        throw std::runtime_error("shared memory map error: "s + std::strerror(errno));
+    }
+    return SharedMemory(address, info.st_size);
+}
+
+void SharedMemory::Unlink(const std::string &name) {
+    shm_unlink(name.c_str());
+}
+
+} // namespace tc
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "transport_catalogue.h"
+
+namespace tc {
+
+/*
+ *  CatalogueImage - read-only view of catalog answers in one contiguous memory block.
+ *
+ *  The layout is position independent: all references are offsets from the block begin,
+ *  so the block may be mapped at any address, e.g. into several processes from shared memory.
+ *  Bus answers are computed on build, buses of every stop are stored as sorted bus indexes.
+ *
+ *  Layout: Header, Bus records sorted by name, Stop records sorted by name,
+ *          bus indexes of stops, strings (names and rendered map)
+ */
+class CatalogueImage {
+public:
+    struct BusInfo {
+        std::string_view name;
+        size_t stops = 0;
+        size_t unique_stops = 0;
+        double length = 0;
+        double curvature = 0;
+    };
+
+    // serialize catalog answers and rendered map (if any) into image block
+    static std::string Build(const TransportCatalogue &catalog, const std::string *map);
+
+    // view of image block, throws std::invalid_argument if block is not a valid image
+    CatalogueImage(const char *data, size_t size);
+
+    // size of image block, bytes
+    size_t GetSize() const;
+    size_t GetBusesCount() const;
+    size_t GetBusStopsCount() const;
+
+    std::optional<BusInfo> FindBus(std::string_view name) const;
+    // sorted names of buses through the stop, nullopt if stop is unknown
+    std::optional<std::vector<std::string_view>> FindBusStop(std::string_view name) const;
+    // rendered map, nullopt if image has no map
+    std::optional<std::string_view> GetMap() const;
+
+private:
+    struct StringRef {
+        uint64_t offset;
+        uint64_t size;
+    };
+    struct Header {
+        char magic[8];
+        uint64_t size;
+        uint64_t buses_count;
+        uint64_t buses_offset;
+        uint64_t stops_count;
+        uint64_t stops_offset;
+        uint64_t stop_buses_offset;
+        uint64_t has_map;
+        StringRef map;
+    };
+    struct BusRecord {
+        StringRef name;
+        uint64_t stops;
+        uint64_t unique_stops;
+        double length;
+        double curvature;
+    };
+    struct StopRecord {
+        StringRef name;
+        uint64_t buses_begin; // index in bus indexes
+        uint64_t buses_count;
+    };
+
+    std::string_view GetString(StringRef ref) const;
+    // binary search of record by name, nullptr if not found
+    template<typename Record>
+    const Record* Find(const Record *records, size_t count, std::string_view name) const;
+
+    const char *data_;
+    const Header *header_;
+};
+
+/*
+ *  SharedMemory - named POSIX shared memory segment mapped into process memory
+ */
+class SharedMemory {
+public:
+    // create segment with data copy, throws std::runtime_error on failure
+    static SharedMemory Create(const std::string &name, std::string_view data);
+    // map existing segment read-only, throws std::runtime_error on failure
+    static SharedMemory Open(const std::string &name);
+    // remove segment name, mapped segments stay valid
+    static void Unlink(const std::string &name);
+
+    SharedMemory(SharedMemory &&other) noexcept;
+    SharedMemory& operator=(SharedMemory &&other) = delete;
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+    ~SharedMemory();
+
+    const char* GetData() const {
+        return static_cast<const char*>(address_);
+    }
+    size_t GetSize() const {
+        return size_;
+    }
+
+private:
+    SharedMemory(void *address, size_t size);
+
+    void *address_;
+    size_t size_;
+};
+
+} // namespace tc
@@ -0,0 +1,205 @@
+/*
+ * catalogue_registry.cpp
+ *
+ *  Region catalogs registry and stat requests router
+ */
+
+#include "catalogue_registry.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "json_reader.h"
+#include "parallel.h"
+
+using namespace std::literals;
+
+namespace tc {
+
+namespace handler {
+
+CatalogueRegistry::CatalogueRegistry(size_t threads) :
+        threads_(std::max<size_t>(1, threads)) {
+    if (threads_ > 1) {
+        // caller thread is a worker too
+        pool_ = std::make_unique<detail::ThreadPool>(threads_ - 1);
+    }
+}
+
+std::shared_ptr<Shard> CatalogueRegistry::LoadShard(std::istream &config) const {
+    auto shard = std::make_shared<Shard>(threads_);
+    tc::reader::Json config_reader(threads_);
+    // render settings are kept by renderer, configuration document is not needed after load
+    config_reader.read_config(shard->catalog, shard->renderer, config);
+    return shard;
+}
+
+void CatalogueRegistry::LoadFiles(const std::vector<std::pair<std::string, std::string>> &region_files) {
+    if (region_files.empty()) {
+        return;
+    }
+    // every region is loaded in own thread, caller thread loads the first one
+    std::unique_ptr<detail::ThreadPool> pool;
+    if (region_files.size() > 1) {
+        pool = std::make_unique<detail::ThreadPool>(region_files.size() - 1);
+    }
+    auto shards = detail::ParallelMap(detail::SplitRange(region_files.size(), region_files.size()),
+            [this, &region_files](size_t begin, size_t) {
+                const auto &file_name = region_files[begin].second;
+                std::ifstream config(file_name);
+                if (!config) {
+                    throw std::invalid_argument("can't open configuration file "s + file_name);
+                }
+                return LoadShard(config);
+            }, pool.get());
+
+    std::lock_guard lock(mutex_);
+    for (size_t i = 0; i < region_files.size(); ++i) {
+        shards_[region_files[i].first] = std::move(shards[i]);
+    }
+}
+
+void CatalogueRegistry::Load(const std::string &region, std::istream &config) {
+    // shard is loaded without lock, requests to all regions are served meanwhile
+    auto shard = LoadShard(config);
+    std::lock_guard lock(mutex_);
+    shards_[region] = std::move(shard);
+}
+
+bool CatalogueRegistry::Remove(std::string_view region) {
+    std::lock_guard lock(mutex_);
+    if (auto search = shards_.find(region); search != shards_.end()) {
+        shards_.erase(search);
+        return true;
+    }
+    return false;
+}
+
+std::shared_ptr<Shard> CatalogueRegistry::GetShard(std::string_view region) const {
+    std::lock_guard lock(mutex_);
+    if (auto search = shards_.find(region); search != shards_.end()) {
+        return search->second;
+    }
+    return nullptr;
+}
+
+std::vector<std::string> CatalogueRegistry::GetRegions() const {
+    std::lock_guard lock(mutex_);
+    std::vector<std::string> result;
+    result.reserve(shards_.size());
+    for (const auto& [region, _] : shards_) {
+        result.push_back(region);
+    }
+    return result;
+}
+
+std::vector<std::pair<std::string, size_t>> CatalogueRegistry::GetMemoryUsage() const {
+    std::lock_guard lock(mutex_);
+    std::vector<std::pair<std::string, size_t>> result;
+    result.reserve(shards_.size());
+    for (const auto& [region, shard] : shards_) {
+        result.emplace_back(region, shard->catalog.GetMemoryUsage());
+    }
+    return result;
+}
+
+std::shared_ptr<Shard> CatalogueRegistry::RouteQuery(const Shards &shards, const json::Dict &query) {
+    auto region = query.find("region"s);
+    if (region == query.end()) {
+        return shards.size() == 1 ? shards.begin()->second : nullptr;
+    }
+    if (!region->second.IsString()) {
+        return nullptr;
+    }
+    if (auto search = shards.find(region->second.AsString()); search != shards.end()) {
+        return search->second;
+    }
+    return nullptr;
+}
+
+json::Document CatalogueRegistry::HandleQueries(const json::LazyDocument &queries_document) const {
+    return HandleQueries(queries_document.GetSection("stat_requests"s).AsArray());
+}
+
+json::Document CatalogueRegistry::HandleQueries(const json::Array &queries) const {
+    // requests of one shard
+    struct Group {
+        std::shared_ptr<Shard> shard;
+        QueryPlan plan;
+    };
+    // answer position: query index in group plan, or request id and error of not routed query
+    struct Route {
+        size_t group;
+        size_t index;
+        int id;
+        std::string_view error;
+    };
+    const size_t NOT_ROUTED = static_cast<size_t>(-1);
+
+    // the batch is handled by shards snapshot, reload of region does not affect it
+    Shards shards;
+    {
+        std::lock_guard lock(mutex_);
+        shards = shards_;
+    }
+
+    std::vector<Group> groups;
+    std::unordered_map<const Shard*, size_t> group_of_shard;
+    std::vector<Route> routes;
+    routes.reserve(queries.size());
+    for (const auto &node : queries) {
+        const auto &query = node.AsDict();
+        auto compiled = RequestHandler::CompileQuery(query);
+        if (!compiled) {
+            continue; // unknown query type has no answer
+        }
+        auto shard = RouteQuery(shards, query);
+        if (!shard) {
+            auto region = query.find("region"s);
+            routes.push_back( { NOT_ROUTED, 0, compiled->id,
+                    region == query.end() || region->second.IsString() ? "region not found"sv : "invalid region"sv });
+            continue;
+        }
+        auto [search, inserted] = group_of_shard.emplace(shard.get(), groups.size());
+        if (inserted) {
+            groups.push_back( { std::move(shard), { } });
+        }
+        auto &group = groups[search->second];
+        routes.push_back( { search->second, group.plan.size(), compiled->id, { } });
+        group.plan.push_back(*compiled);
+    }
+
+    // shards handle their queries concurrently by registry threads, every shard with own handler thread pool
+    std::vector<json::Array> answers;
+    answers.reserve(groups.size());
+    for (auto &range_answers : detail::ParallelMap(detail::SplitRange(groups.size(), threads_),
+            [&groups](size_t begin, size_t end) {
+                std::vector<json::Array> result;
+                for (size_t i = begin; i < end; ++i) {
+                    auto &group = groups[i];
+                    result.push_back(std::move(group.shard->handler.HandleQueries(group.shard->catalog, group.plan,
+                            group.shard->renderer).GetRoot().AsArray()));
+                }
+                return result;
+            }, pool_.get())) {
+        for (auto &group_answers : range_answers) {
+            answers.push_back(std::move(group_answers));
+        }
+    }
+
+    json::Array result;
+    result.reserve(routes.size());
+    for (const auto &route : routes) {
+        if (route.group == NOT_ROUTED) {
+            result.push_back(json::Dict { { "request_id"s, route.id }, { "error_message"s, std::string(route.error) } });
+        } else {
+            result.push_back(std::move(answers[route.group][route.index]));
+        }
+    }
+    return json::Document { std::move(result) };
+}
+
+} // namespace handler
+
+} // namespace tc
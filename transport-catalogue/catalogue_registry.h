@@ -0,0 +1,86 @@
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "json.h"
+#include "map_renderer.h"
+#include "parallel.h"
+#include "request_handler.h"
+#include "transport_catalogue.h"
+
+namespace tc {
+
+namespace handler {
+
+// Shard - catalog of one region with own renderer and request handler (and handler thread pool)
+struct Shard {
+    explicit Shard(size_t threads) :
+            handler(threads) {
+    }
+
+    tc::TransportCatalogue catalog;
+    tc::renderer::Map renderer;
+    RequestHandler handler;
+};
+
+/*
+ *  CatalogueRegistry - catalogs of several regions and stat requests router.
+ *
+ *  Stat request is routed to shard by its "region" key, request without region key is routed
+ *  to the only shard of registry. Requests of every shard are handled by the shard handler,
+ *  shards handle their requests concurrently.
+ *  Shard is not changed after load. Reload of region replaces its shard,
+ *  requests in progress keep using the old one.
+ */
+class CatalogueRegistry {
+public:
+    // threads - number of threads of every shard loader and request handler,
+    // and number of threads handling queries of different shards
+    explicit CatalogueRegistry(size_t threads = 1);
+
+    // load regions in parallel, pairs of region name and JSON configuration file name.
+    // throws std::invalid_argument if file can't be opened
+    void LoadFiles(const std::vector<std::pair<std::string, std::string>> &region_files);
+    // load or reload region from JSON configuration stream, other regions are not affected
+    void Load(const std::string &region, std::istream &config);
+    // returns false if region is unknown
+    bool Remove(std::string_view region);
+
+    // shard of region, nullptr if region is unknown
+    std::shared_ptr<Shard> GetShard(std::string_view region) const;
+    // sorted regions names
+    std::vector<std::string> GetRegions() const;
+    // approximate catalog memory of every region, bytes
+    std::vector<std::pair<std::string, size_t>> GetMemoryUsage() const;
+
+    // handle "stat_requests" section of lazy loaded document
+    json::Document HandleQueries(const json::LazyDocument &queries_document) const;
+    // handle array of stat requests, answers are in requests order.
+    // request of unknown region gets answer with error_message "region not found",
+    // request with not string region gets answer with error_message "invalid region"
+    json::Document HandleQueries(const json::Array &queries) const;
+
+private:
+    using Shards = std::map<std::string, std::shared_ptr<Shard>, std::less<>>;
+
+    std::shared_ptr<Shard> LoadShard(std::istream &config) const;
+    // shard for request by "region" key, nullptr if not found or region is not a string
+    static std::shared_ptr<Shard> RouteQuery(const Shards &shards, const json::Dict &query);
+
+    size_t threads_;
+    // shards handle queries of batch concurrently, nullptr for one thread
+    std::unique_ptr<detail::ThreadPool> pool_;
+    mutable std::mutex mutex_;
+    Shards shards_;
+};
+
+} // namespace handler
+
+} // namespace tc
@@ -1,6 +1,7 @@
 #include "domain.h"
 #include <iostream>
 #include <cassert>
+#include <charconv>
 
 namespace tc {
 namespace detail {
@@ -47,6 +48,34 @@ std::istream& operator >>(std::istream &is, DistanceInfo &di) {
     return is;
 }
 
+bool ParseDouble(std::string_view text, double &value) {
+    text = trimSpaces(text);
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc() && end == text.data() + text.size();
+}
+
+// the distance info block "Dm to stop"
+bool ParseDistanceInfo(std::string_view text, size_t &distance, std::string_view &destination) {
+    using namespace std::string_view_literals;
+    text = trimSpaces(text);
+    // read distance and char 'm'
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), distance);
+    if (error != std::errc()) {
+        return false;
+    }
+    text.remove_prefix(end - text.data());
+    if (text.empty() || text.front() != 'm') {
+        return false;
+    }
+    // read word "to"
+    text = trimSpaces(text.substr(1));
+    if (text.substr(0, 2) != "to"sv || text.size() < 3 || text[2] != ' ') {
+        return false;
+    }
+    destination = trimSpaces(text.substr(2));
+    return !destination.empty();
+}
+
 } //namespace detail
 
 } // namespace tc
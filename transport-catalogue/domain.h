@@ -20,6 +20,12 @@ struct DistanceInfo {
 // read BusStop info from line
 std::istream& operator>>(std::istream &is, DistanceInfo &di);
 
+// parse double number surrounded by spaces, returns false on error
+bool ParseDouble(std::string_view text, double &value);
+
+// parse distance info block "Dm to stop", returns false on error
+bool ParseDistanceInfo(std::string_view text, size_t &distance, std::string_view &destination);
+
 } //namespace detail
 
 using DistanceInfoVector = std::vector<std::pair<std::string, detail::DistanceInfo>>;
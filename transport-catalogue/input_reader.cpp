@@ -1,131 +1,221 @@
+#include <algorithm>
+#include <deque>
 #include <vector>
 #include <string>
-#include <sstream>
 #include <unordered_map>
+#include <charconv>
+#include <stdexcept>
 #include <cassert>
 #include "input_reader.h"
 
 namespace tc {
 
 namespace reader {
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+// cut the next line from text, line end is not included
+static std::string_view NextLine(std::string_view &text) {
+    auto end = text.find('\n');
+    auto line = text.substr(0, end);
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    return line;
+}
+
+// cut the next token up to delimiter from text, delimiter is not included
+static std::string_view NextToken(std::string_view &text, char delimiter) {
+    auto end = text.find(delimiter);
+    auto token = text.substr(0, end);
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+    return token;
+}
+
+// read name of record "Word name: ...", the text is left after ':'
+static std::string_view ReadRecordName(std::string_view &text, std::string_view word) {
+    assert(text.substr(0, word.size()) == word);
+    text.remove_prefix(word.size());
+    text.remove_prefix(std::min(text.find_first_not_of(' '), text.size()));
+    return NextToken(text, ':');
+}
+
+// BusStops are referred by ids in order of the first mention
+using StopId = size_t;
+
+struct Input::LoadState {
+    struct StopRecord {
+        geo::Coordinates coords { };
+        bool defined = false;
+    };
+    struct DistanceRecord {
+        StopId from;
+        StopId to;
+        size_t distance;
+    };
+    struct BusRecord {
+        std::string name;
+        BusType type;
+        std::vector<StopId> stops;
+    };
+
+    // returns id of BusStop name, placeholder BusStop is created on the first mention
+    StopId Intern(std::string_view name) {
+        if (auto search = ids.find(name); search != ids.end()) {
+            return search->second;
+        }
+        const auto &stored = names.emplace_back(name);
+        stops.emplace_back();
+        return ids[stored] = names.size() - 1;
+    }
+
+    // interned names, deque keeps names in place for ids keys
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, StopId> ids;
+    std::vector<StopRecord> stops; // by id
+    std::vector<StopId> defined_order; // ids of BusStops in order of definition
+    std::vector<DistanceRecord> distances;
+    std::vector<BusRecord> buses;
+};
+
 //
 // read data from stream and insert it in TransportCatalogue
 //
 void Input::Process(std::istream &in, TransportCatalogue &catalog) {
-    // read number of configuration lines
-    int records;
-    in >> records;
-    // remember all Bus strings for future processing after all BusStops became known
-    std::vector<std::string> bus_buffer;
-    bus_buffer.reserve(records);
-    // read line buffer
-    std::string line;
-    std::getline(in, line); // eat endl of first line
-
-    // distances info for
-    DistanceInfoVector distances; // vector of pairs <name, distance_dinfo >
-
-    for (int i = 0; i < records; ++i) {
-        std::getline(in, line);
-        if (auto pos = line.find("Bus "); pos == 0) {
-            // store bus line in buffer for future processing
-            bus_buffer.push_back(std::move(line));
-        } else if (auto pos = line.find("Stop "); pos == 0) {
-            catalog.AddBusStop(ReadBusStop(line, distances));
-        }
-    }
-    // add distance information to catalog
-    for (const auto& [name, distance_info] : distances) {
-        catalog.SetSegmentDistance(name, distance_info.destination, distance_info.distance);
+    // records are taken into one buffer and parsed from text,
+    // the rest of stream is left for stat requests
+    std::string text;
+    if (const auto start = in.tellg(); start != std::istream::pos_type(-1)) {
+        // seekable stream is read at once and positioned after the last record
+        in.seekg(0, std::ios::end);
+        text.resize(static_cast<size_t>(in.tellg() - start));
+        in.seekg(start);
+        in.read(text.data(), text.size());
+        const size_t processed = Process(text, catalog);
+        in.clear();
+        in.seekg(start + static_cast<std::streamoff>(processed));
+        return;
     }
-    // all Bus stops added to catalog
-    // now we need to add all busses from string buffer
-    for (const auto &bus_line : bus_buffer) {
-        catalog.AddBus(ReadBus(bus_line, catalog));
+
+    // lines of records number and records are appended to buffer directly from stream buffer
+    auto read_line = [buffer = in.rdbuf(), &text]() {
+        for (auto ch = buffer->sbumpc(); ch != std::char_traits<char>::eof(); ch = buffer->sbumpc()) {
+            text.push_back(static_cast<char>(ch));
+            if (ch == '\n') {
+                return true;
+            }
+        }
+        return false;
+    };
+    read_line();
+    std::string_view first_line = text;
+    first_line = detail::trimSpaces(NextLine(first_line));
+    int records = 0;
+    std::from_chars(first_line.data(), first_line.data() + first_line.size(), records);
+    for (int i = 0; i < records && read_line(); ++i) {
     }
+    Process(text, catalog);
 }
 
-BusStop Input::ReadBusStop(const std::string &line, DistanceInfoVector &distances) {
-    // read bus stop "Stop X: latitude, longitude, D1m to stop1, D2m to stop2, ...
-    using namespace std::string_literals;
-    std::string name;
-
-    std::stringstream str_in(line);
-    str_in >> name; // read word "Stop"
-    assert(name == "Stop"s);
-    while (str_in.peek() == ' ') { // read all spaces
-        str_in.get();
+size_t Input::Process(std::string_view text, TransportCatalogue &catalog) {
+    std::string_view rest = text;
+    auto first_line = detail::trimSpaces(NextLine(rest));
+    int records = 0;
+    auto [end, error] = std::from_chars(first_line.data(), first_line.data() + first_line.size(), records);
+    if (error != std::errc()) {
+        throw std::invalid_argument("wrong records number: "s + std::string(first_line));
     }
-    std::getline(str_in, name, ':'); // read busStop name up to ':'
 
-    double latitude;
-    double longtitude;
-    char ch;
-    // read coordinates
-    str_in >> latitude >> ch >> longtitude;
-
-    // extraction distances info
-    if (str_in >> ch && ch == ',') { // if ',' than distance info exists
-        detail::DistanceInfo distance_info;
-        while (str_in.good()) {
-            str_in >> distance_info;
-            distances.emplace_back(name, distance_info); // remember distance info in vector for future process
-            str_in >> ch; // read ','
-        }
+    LoadState state;
+    for (int i = 0; i < records && !rest.empty(); ++i) {
+        ReadRecord(NextLine(rest), state);
     }
+    Commit(state, catalog);
+    return text.size() - rest.size();
+}
 
-    return {name, {latitude, longtitude}};
+void Input::ReadRecord(std::string_view line, LoadState &state) {
+    if (line.substr(0, 4) == "Bus "sv) {
+        ReadBus(line, state);
+    } else if (line.substr(0, 5) == "Stop "sv) {
+        ReadBusStop(line, state);
+    }
 }
 
-Bus Input::ReadBus(const std::string &line, const TransportCatalogue &catalog) {
-    // read bus from line : "Bus X:stop1 - stop2 - ... stopN"
-    //                      "Bus X:stop1 > stop2 > ... > stopN > stop1"
-    using namespace std::string_literals;
-    std::string name;
-
-    std::stringstream str_in(line);
-    str_in >> name; // "Bus"
-    assert(name == "Bus"s);
-    while (str_in.peek() == ' ') { // eat spaces
-        str_in.get();
+void Input::Commit(LoadState &state, TransportCatalogue &catalog) {
+    for (StopId id = 0; id < state.stops.size(); ++id) {
+        if (!state.stops[id].defined) {
+            throw std::invalid_argument("bus stop is never defined: "s + state.names[id]);
+        }
     }
-    std::getline(str_in, name, ':'); // name of bus has been read
-    while (str_in.peek() == ' ') { // eat spaces
-        str_in.get();
+    // add BusStops in order of definition and remember their catalog entries
+    std::vector<const BusStop*> stops(state.stops.size());
+    for (StopId id : state.defined_order) {
+        catalog.AddBusStop(BusStop(state.names[id], state.stops[id].coords));
+        stops[id] = catalog.GetBusStop(state.names[id]);
     }
+    // add distance information to catalog
+    for (const auto &distance : state.distances) {
+        catalog.SetSegmentDistance(state.names[distance.from], state.names[distance.to], distance.distance);
+    }
+    for (auto &record : state.buses) {
+        Bus bus(record.name, record.type);
+        for (StopId id : record.stops) {
+            bus.AddBusStop(stops[id]);
+        }
+        catalog.AddBus(std::move(bus));
+    }
+}
 
-    char delimiter = 0; // delimiter busStops names. '>' or  '-'
+void Input::ReadBusStop(std::string_view line, LoadState &state) {
+    // read bus stop "Stop X: latitude, longitude, D1m to stop1, D2m to stop2, ...
+    auto name = ReadRecordName(line, "Stop"sv);
+    StopId id = state.Intern(name);
 
-    Bus bus(name);
+    auto &stop = state.stops[id];
+    // read coordinates
+    if (!detail::ParseDouble(NextToken(line, ','), stop.coords.lat)
+            || !detail::ParseDouble(NextToken(line, ','), stop.coords.lng)) {
+        throw std::invalid_argument("wrong coordinates of stop: "s + std::string(name));
+    }
+    if (!stop.defined) {
+        stop.defined = true;
+        state.defined_order.push_back(id);
+    }
 
-    // now we use variable name as BusStop name buffer;
-    char ch;
-    name.resize(0);
-    name.reserve(line.size());
-    // read BusStop names and find delimiter of names
-    while (str_in.get(ch)) {
-        // if we don't know busStop name delimiter - remember it
-        if (delimiter == 0 && (ch == '-' || ch == '>')) {
-            delimiter = ch;
+    // extraction distances info, blocks are separated by ','
+    while (!line.empty()) {
+        size_t distance = 0;
+        std::string_view destination;
+        if (!detail::ParseDistanceInfo(NextToken(line, ','), distance, destination)) {
+            throw std::invalid_argument("wrong distance info of stop: "s + std::string(name));
         }
-        // if char if not delimiter - remember it
-        if (delimiter == 0 || (delimiter != 0 && ch != delimiter)) {
-            name.push_back(ch);
-        } else { // char if delimiter - than busStop name has been read - remember it in bus info
-            bus.AddBusStop(catalog.GetBusStop(detail::trimSpaces(name)));
-            name.resize(0); // reset buffer for next busStop
+        // destination may be defined later
+        state.distances.push_back( { id, state.Intern(destination), distance });
+    }
+}
+
+void Input::ReadBus(std::string_view line, LoadState &state) {
+    // read bus from line : "Bus X:stop1 - stop2 - ... stopN"
+    //                      "Bus X:stop1 > stop2 > ... > stopN > stop1"
+    auto &bus = state.buses.emplace_back();
+    bus.name = ReadRecordName(line, "Bus"sv);
+
+    // delimiter of busStops names is the first '>' or '-'
+    auto pos = line.find_first_of("->"sv);
+    char delimiter = pos == std::string_view::npos ? 0 : line[pos];
+
+    // read BusStop names, BusStops may be defined later
+    while (!line.empty()) {
+        auto name = detail::trimSpaces(NextToken(line, delimiter));
+        if (name.length() > 0 || !line.empty()) {
+            bus.stops.push_back(state.Intern(name));
         }
-    } // while
-      // process last busStop name in line
-    name = detail::trimSpaces(name);
-    if (name.length() > 0) {
-        bus.AddBusStop(catalog.GetBusStop(name));
     }
     //set the bus type LINEAR or CIRCULAR according to the delimiter symbol
-    BusType type = delimiter == '>' ? BusType::CIRCULAR : BusType::LINEAR;
-    bus.SetType(type);
-
-    return bus;
+    bus.type = delimiter == '>' ? BusType::CIRCULAR : BusType::LINEAR;
 }
 
 }    // namespace reader{
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <iostream>
+#include <string>
+#include <string_view>
 #include "domain.h"
 #include "transport_catalogue.h"
 
@@ -8,16 +10,29 @@ namespace tc {
 
 namespace reader {
 
-// Bus and Bus Stop reader from text files
+// Bus and Bus Stop reader from text files.
+// Records are read in one pass: Buses and distances may refer to BusStops defined later,
+// such BusStops are resolved when all records are read
 
 class Input {
 public:
+    // read records number line and records from stream into one buffer and process it as text,
+    // stream stays at the line after the last record
     void Process(std::istream &in, TransportCatalogue &catalog);
+    // read records number line and records from text buffer, returns size of processed text
+    size_t Process(std::string_view text, TransportCatalogue &catalog);
 private:
+    // records read so far, defined in input_reader.cpp
+    struct LoadState;
+
+    // read one record line into state
+    void ReadRecord(std::string_view line, LoadState &state);
     // read BusStop information from string
-    BusStop ReadBusStop(const std::string &line, DistanceInfoVector &distances);
+    void ReadBusStop(std::string_view line, LoadState &state);
     // read Bus information from string
-    Bus ReadBus(const std::string &line, const TransportCatalogue &catalog);
+    void ReadBus(std::string_view line, LoadState &state);
+    // add all records to catalog, throws std::invalid_argument if some BusStop is never defined
+    void Commit(LoadState &state, TransportCatalogue &catalog);
 
 };
 
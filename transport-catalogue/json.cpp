@@ -1,6 +1,8 @@
 #include "json.h"
 #include <exception>
 #include <cmath>
+#include <iterator>
+#include <sstream>
 
 using namespace std;
 
@@ -248,8 +250,12 @@ Node::Node(std::nullptr_t value) :
         value_(value) {
 }
 
-Node::Node(const string &value) :
-        value_(value) {
+Node::Node(string value) :
+        value_(move(value)) {
+}
+
+Node::Node(EscapedString value) :
+        value_(move(value)) {
 }
 
 Document::Document(Node root) :
@@ -260,10 +266,173 @@ const Node& Document::GetRoot() const {
     return root_;
 }
 
+Node& Document::GetRoot() {
+    return root_;
+}
+
 Document Load(istream &input) {
     return Document { LoadNode(input) };
 }
 
+// returns position of first non space char starting from pos
+size_t SkipSpaces(string_view text, size_t pos) {
+    while (pos < text.size() && isspace(static_cast<unsigned char>(text[pos]))) {
+        ++pos;
+    }
+    return pos;
+}
+
+// pos points to char after opening '"', returns position after closing '"'
+size_t SkipString(string_view text, size_t pos) {
+    while (pos < text.size() && text[pos] != '"') {
+        pos += text[pos] == '\\' ? 2 : 1;
+    }
+    if (pos >= text.size()) {
+        throw ParsingError("string parsing error : ending '\"' required but not found");
+    }
+    return pos + 1;
+}
+
+// pos points to first char of value, returns position after value end
+size_t SkipValue(string_view text, size_t pos) {
+    if (pos >= text.size()) {
+        throw ParsingError("unexpected input end");
+    }
+    if (text[pos] == '"') {
+        return SkipString(text, pos + 1);
+    }
+    if (text[pos] == '[' || text[pos] == '{') {
+        // skip nested containers, strings may contain brackets
+        int level = 0;
+        while (pos < text.size()) {
+            char ch = text[pos];
+            if (ch == '"') {
+                pos = SkipString(text, pos + 1);
+                continue;
+            }
+            if (ch == '[' || ch == '{') {
+                ++level;
+            } else if (ch == ']' || ch == '}') {
+                if (--level == 0) {
+                    return pos + 1;
+                }
+            }
+            ++pos;
+        }
+        throw ParsingError("container parsing error : closing bracket required but not found");
+    }
+    // number, bool or null
+    while (pos < text.size() && text[pos] != ',' && text[pos] != '}' && text[pos] != ']'
+            && !isspace(static_cast<unsigned char>(text[pos]))) {
+        ++pos;
+    }
+    return pos;
+}
+
+LazyDocument::LazyDocument(string text) :
+        text_(move(text)) {
+    size_t pos = SkipSpaces(text_, 0);
+    if (pos >= text_.size() || text_[pos] != '{') {
+        throw ParsingError("lazy document : top-level Dict required");
+    }
+    pos = SkipSpaces(text_, pos + 1);
+    while (pos < text_.size() && text_[pos] != '}') {
+        if (text_[pos] != '"') {
+            throw ParsingError("lazy document : key string required");
+        }
+        size_t key_end = SkipString(text_, pos + 1);
+        istringstream key_input(text_.substr(pos + 1, key_end - pos - 1));
+        string key = LoadString(key_input).AsString();
+
+        pos = SkipSpaces(text_, key_end);
+        if (pos >= text_.size() || text_[pos] != ':') {
+            throw ParsingError("Map parsing error : ':' required but not found");
+        }
+        pos = SkipSpaces(text_, pos + 1);
+        size_t value_end = SkipValue(text_, pos);
+        // first key wins as in LoadDict
+        sections_.emplace(move(key), Section { pos, value_end, nullopt });
+
+        pos = SkipSpaces(text_, value_end);
+        if (pos < text_.size() && text_[pos] == ',') {
+            pos = SkipSpaces(text_, pos + 1);
+            if (pos < text_.size() && text_[pos] == '}') {
+                throw ParsingError("Map parsing error : key required after ','");
+            }
+        } else if (pos < text_.size() && text_[pos] != '}') {
+            throw ParsingError("Map parsing error : ',' or '}' required but not found");
+        }
+    }
+    if (pos >= text_.size()) {
+        throw ParsingError("Map parsing error : '}' required but not found");
+    }
+    if (SkipSpaces(text_, pos + 1) != text_.size()) {
+        throw ParsingError("lazy document : unexpected content after top-level Dict");
+    }
+}
+
+bool LazyDocument::HasSection(const string &key) const {
+    return sections_.count(key) > 0;
+}
+
+string_view LazyDocument::GetSectionText(const string &key) const {
+    const auto &section = sections_.at(key);
+    return string_view(text_).substr(section.begin, section.end - section.begin);
+}
+
+const Node& LazyDocument::GetSection(const string &key) const {
+    const auto &section = sections_.at(key);
+    if (!section.node) {
+        istringstream input(string(GetSectionText(key)));
+        section.node = LoadNode(input);
+    }
+    return *section.node;
+}
+
+void LazyDocument::ReleaseSection(const string &key) {
+    if (auto search = sections_.find(key); search != sections_.end()) {
+        search->second.node.reset();
+    }
+}
+
+vector<string_view> SplitArray(string_view text) {
+    vector<string_view> result;
+    size_t pos = SkipSpaces(text, 0);
+    if (pos >= text.size() || text[pos] != '[') {
+        throw ParsingError("array parsing error : '[' required");
+    }
+    pos = SkipSpaces(text, pos + 1);
+    while (pos < text.size() && text[pos] != ']') {
+        size_t value_end = SkipValue(text, pos);
+        result.push_back(text.substr(pos, value_end - pos));
+        pos = SkipSpaces(text, value_end);
+        if (pos < text.size() && text[pos] == ',') {
+            pos = SkipSpaces(text, pos + 1);
+        }
+    }
+    if (pos >= text.size()) {
+        throw ParsingError("array parsing error : end ']' required but not found");
+    }
+    return result;
+}
+
+Array LoadArrayElements(string_view text) {
+    Array result;
+    istringstream input { string(text) };
+    char ch = 0;
+    while (input >> ch) {
+        if (ch != ',') {
+            input.putback(ch);
+        }
+        result.push_back(LoadNode(input));
+    }
+    return result;
+}
+
+LazyDocument LoadLazy(istream &input) {
+    return LazyDocument(string(istreambuf_iterator<char>(input), istreambuf_iterator<char>()));
+}
+
 bool Node::IsInt() const {
     return std::holds_alternative<int>(value_);
 }
@@ -288,6 +457,10 @@ bool Node::IsString() const {
     return std::holds_alternative<std::string>(value_);
 }
 
+bool Node::IsEscapedString() const {
+    return std::holds_alternative<EscapedString>(value_);
+}
+
 bool Node::IsArray() const {
     return std::holds_alternative<Array>(value_);
 }
@@ -370,10 +543,99 @@ const string& Node::AsString() const {
     throw std::logic_error("Value is type is not string");
 }
 
+const EscapedString& Node::AsEscapedString() const {
+    if (IsEscapedString()) {
+        return std::get<EscapedString>(value_);
+    }
+    throw std::logic_error("Value is type is not escaped string");
+}
+
+EscapedString EscapedString::Escape(std::string_view value) {
+    auto text = std::make_shared<std::string>();
+    AppendEscaped(*text, value);
+    return EscapedString(std::move(text));
+}
+
+const std::string& EscapedString::GetText() const {
+    static const std::string empty;
+    return text_ ? *text_ : empty;
+}
+
+std::string EscapedString::Unescape() const {
+    const auto &text = GetText();
+    std::string result;
+    result.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        char ch = text[i];
+        if (ch == '\\' && i + 1 < text.size()) {
+            switch (text[++i]) {
+            case 'r':
+                ch = '\r';
+                break;
+            case 'n':
+                ch = '\n';
+                break;
+            default:
+                ch = text[i];
+            }
+        }
+        result.push_back(ch);
+    }
+    return result;
+}
+
+// escape sequence of character, nullptr if character is printed as is
+static const char* GetEscape(char ch) {
+    switch (ch) {
+    case '\r':
+        return "\\r";
+    case '\\':
+        return "\\\\";
+    case '\n':
+        return "\\n";
+    case '"':
+        return "\\\"";
+    default:
+        return nullptr;
+    }
+}
+
+void AppendEscaped(std::string &output, std::string_view value) {
+    // runs of plain characters are appended at once
+    size_t begin = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (const char *escape = GetEscape(value[i])) {
+            output.append(value.data() + begin, i - begin);
+            output.append(escape);
+            begin = i + 1;
+        }
+    }
+    output.append(value.data() + begin, value.size() - begin);
+}
+
+EscapingStreambuf::int_type EscapingStreambuf::overflow(int_type ch) {
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        const char value = traits_type::to_char_type(ch);
+        AppendEscaped(output_, std::string_view(&value, 1));
+    }
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize EscapingStreambuf::xsputn(const char *data, std::streamsize size) {
+    AppendEscaped(output_, std::string_view(data, static_cast<size_t>(size)));
+    return size;
+}
+
 void Print(const Document &doc, std::ostream &output) {
     PrintNode(doc.GetRoot(), PrintContext { output });
 }
 
+void PrintCompact(const Node &node, std::ostream &output) {
+    PrintContext context { output };
+    context.compact = true;
+    PrintNode(node, context);
+}
+
 void PrintValue(const std::nullptr_t, PrintContext context) {
     context.os << "null";
 }
@@ -383,37 +645,31 @@ void PrintValue(bool value, PrintContext context) {
 }
 void PrintValue(const std::string &value, PrintContext context) {
     auto &out = context.os;
-    out << "\""s;
-    for (const auto ch : value) {
-        switch (ch) {
-        case '\r': {
-            out << "\\r";
-            break;
-        }
-        case '\\': {
-            out << "\\\\";
-            break;
-        }
-        case '\n': {
-            out << "\\n";
-            break;
-        }
-        case '"': {
-            out << "\\\"";
-            break;
-        }
-        default: {
-            out << ch;
-        }
+    out.put('"');
+    // runs of plain characters are written at once
+    size_t begin = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (const char *escape = GetEscape(value[i])) {
+            out.write(value.data() + begin, i - begin);
+            out << escape;
+            begin = i + 1;
         }
     }
-    out << "\""s;
+    out.write(value.data() + begin, value.size() - begin);
+    out.put('"');
+}
+
+void PrintValue(const EscapedString &value, PrintContext context) {
+    const auto &text = value.GetText();
+    context.os.put('"');
+    context.os.write(text.data(), text.size());
+    context.os.put('"');
 }
 
 void PrintValue(const Array &value, PrintContext context) {
     auto &out = context.os;
     out << "[";
-    out << std::endl;
+    context.PrintLineBreak();
 
     auto newContext = context.Indented();
     bool first = true;
@@ -422,14 +678,14 @@ void PrintValue(const Array &value, PrintContext context) {
             first = false;
         } else {
             out << ",";
-            out << std::endl;
+            context.PrintLineBreak();
         }
 
         newContext.PrintIndent();
         PrintNode(node, newContext);
     }
 
-    out << std::endl;
+    context.PrintLineBreak();
     context.PrintIndent();
     out << "]";
 }
@@ -437,7 +693,8 @@ void PrintValue(const Array &value, PrintContext context) {
 void PrintValue(const Map &value, PrintContext context) {
     auto &out = context.os;
 
-    out << "{" << std::endl;
+    out << "{";
+    context.PrintLineBreak();
 
     auto newContext = context.Indented();
     bool first = true;
@@ -446,14 +703,14 @@ void PrintValue(const Map &value, PrintContext context) {
             first = false;
         } else {
             out << ",";
-            out << std::endl;
+            context.PrintLineBreak();
         }
         newContext.PrintIndent();
-        newContext.os << "\"" << key << "\": ";
+        newContext.os << "\"" << key << (context.compact ? "\":" : "\": ");
         PrintNode(node, newContext);
     }
 
-    out << std::endl;
+    context.PrintLineBreak();
     context.PrintIndent();
     out << "}";
 }
@@ -2,7 +2,11 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
+#include <optional>
+#include <streambuf>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <variant>
 
@@ -23,8 +27,32 @@ public:
     }
 };
 
+// EscapedString - string value kept in printed form: escaped text without quotes.
+// Text is shared by copies of node, so large strings are escaped once and printed without copying
+class EscapedString {
+public:
+    EscapedString() = default;
+    // text must be escaped by AppendEscaped or EscapingStreambuf
+    explicit EscapedString(std::shared_ptr<const std::string> text) :
+            text_(std::move(text)) {
+    }
+
+    static EscapedString Escape(std::string_view value);
+
+    const std::string& GetText() const;
+    // original string value
+    std::string Unescape() const;
+
+    bool operator==(const EscapedString &other) const {
+        return GetText() == other.GetText();
+    }
+
+private:
+    std::shared_ptr<const std::string> text_;
+};
+
 using Value =std::variant<std::nullptr_t, bool, double, int, json::Array, json::Dict,
-std::string>;
+std::string, EscapedString>;
 
 class Node {
 public:
@@ -34,7 +62,8 @@ public:
     Node(int value);
     Node(double value);
     Node(bool value);
-    Node(const std::string &value);
+    Node(std::string value);
+    Node(EscapedString value);
     Node(std::nullptr_t value);
 
     // variant
@@ -46,6 +75,7 @@ public:
     bool IsNull() const;
     bool IsBool() const;
     bool IsString() const;
+    bool IsEscapedString() const;
     bool IsArray() const;
     bool IsMap() const;
     bool IsDict() const;
@@ -55,6 +85,7 @@ public:
     //. Возвращает значение типа double, если внутри хранится double либо int. В последнем случае возвращается приведённое в double значение.
     double AsDouble() const;
     const std::string& AsString() const;
+    const EscapedString& AsEscapedString() const;
     const Array& AsArray() const;
     Array& AsArray();
     const Map& AsMap() const;
@@ -84,6 +115,7 @@ public:
     explicit Document(Node root);
 
     const Node& GetRoot() const;
+    Node& GetRoot();
 
 private:
     Node root_;
@@ -95,28 +127,93 @@ inline bool operator!=(const Document &lhs, const Document &rhs) {
     return !(lhs == rhs);
 }
 
+// LazyDocument - top-level JSON dict with sections parsed on first access.
+// On load only byte ranges of top-level values are recorded.
+// GetSection is not thread safe: it caches parsed section on first call.
+class LazyDocument {
+public:
+    explicit LazyDocument(std::string text);
+
+    bool HasSection(const std::string &key) const;
+    // parse section on first access, throws std::out_of_range if section does not exist
+    const Node& GetSection(const std::string &key) const;
+    // raw text of section value, throws std::out_of_range if section does not exist
+    std::string_view GetSectionText(const std::string &key) const;
+    // free parsed section, next GetSection call will parse it again
+    void ReleaseSection(const std::string &key);
+
+private:
+    struct Section {
+        size_t begin = 0;
+        size_t end = 0;
+        mutable std::optional<Node> node;
+    };
+
+    std::string text_;
+    std::map<std::string, Section> sections_;
+};
+
 struct PrintContext {
     std::ostream &os;
     int indent_step = 4;
     int indent = 0;
+    // compact context prints without line breaks and indents
+    bool compact = false;
 
     void PrintIndent() {
+        if (compact) {
+            return;
+        }
         for (int i = 0; i < indent; ++i) {
             os.put(' ');
         }
     }
 
+    void PrintLineBreak() {
+        if (!compact) {
+            os << std::endl;
+        }
+    }
+
     PrintContext Indented() {
-        return {os, indent_step, indent + indent_step};
+        return {os, indent_step, indent + indent_step, compact};
     }
 };
 
 Document Load(std::istream &input);
+// read whole stream and index top-level sections without parsing them
+LazyDocument LoadLazy(std::istream &input);
+// split text of JSON array into texts of its elements without parsing them
+std::vector<std::string_view> SplitArray(std::string_view text);
+// parse comma separated JSON values (text between first and last element of array)
+Array LoadArrayElements(std::string_view text);
+
+// append value escaped as JSON string content without quotes
+void AppendEscaped(std::string &output, std::string_view value);
+
+// EscapingStreambuf - stream buffer appending written characters escaped as JSON string content,
+// so text rendered into std::ostream over it is escaped in the same pass
+class EscapingStreambuf: public std::streambuf {
+public:
+    explicit EscapingStreambuf(std::string &output) :
+            output_(output) {
+    }
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char *data, std::streamsize size) override;
+
+private:
+    std::string &output_;
+};
 
 void Print(const Document &doc, std::ostream &output);
+// print node in one line without line breaks and indents
+void PrintCompact(const Node &node, std::ostream &output);
 void PrintValue(std::nullptr_t, PrintContext context);
 void PrintValue(bool value, PrintContext context);
 void PrintValue(const std::string &value, PrintContext context);
+void PrintValue(const EscapedString &value, PrintContext context);
 void PrintValue(const Array &value, PrintContext context);
 void PrintValue(const Map &value, PrintContext context);
 
@@ -7,231 +7,113 @@
 
 #include "json_builder.h"
 
-namespace json {
+using namespace std::literals;
 
-Builder::Builder() {
-    PushBackState(std::make_unique<BuilderInitState>(*this));
-}
+namespace json {
 
 Builder& Builder::Value(json::Node node) {
-    GetState().Value(std::move(node));
+    PlaceForValue("Value") = std::move(node);
     return *this;
 }
 
 StartDictResult Builder::StartDict() {
-    GetState().StartDict();
+    auto &place = PlaceForValue("StartDict");
+    place = json::Dict();
+    PushFrame(place, FrameType::DICT);
     return {*this};
 }
 
 StartArrayResult Builder::StartArray() {
-    GetState().StartArray();
+    auto &place = PlaceForValue("StartArray");
+    place = json::Array();
+    PushFrame(place, FrameType::ARRAY);
     return {*this};
 }
 
 Builder& Builder::EndDict() {
-    GetState().EndDict();
-    PopBackState();
-    GetState().ProcessBackNode();
+    CloseContainer(FrameType::DICT, "EndDict");
     return *this;
 }
 
 Builder& Builder::EndArray() {
-    GetState().EndArray();
-    PopBackState();
-    GetState().ProcessBackNode();
+    CloseContainer(FrameType::ARRAY, "EndArray");
     return *this;
 }
 
 Builder& Builder::KeyPrimary(std::string key) {
-    GetState().Key(std::move(key));
+    if (depth_ == 0 || TopFrame().type != FrameType::DICT) {
+        throw std::logic_error("Key called outside of Dict or secondary Key call in Dict state");
+    }
+    // value slot is created in place, next Value/StartDict/StartArray will fill it
+    auto &slot = TopFrame().node->AsDict()[std::move(key)];
+    PushFrame(slot, FrameType::DICT_VALUE);
     return *this;
 }
 
 DictKeyResult Builder::Key(std::string key) {
-    return {KeyPrimary(key)};
-}
-
-BuilderState& Builder::GetState() {
-    return *state_stack.back();
-}
-
-void Builder::PushBackState(std::unique_ptr<BuilderState> &&state) {
-    state_stack.emplace_back(std::move(state));
-}
-
-void Builder::PopBackState() {
-    state_stack.pop_back();
-}
-
-std::unique_ptr<json::Node>& Builder::GetBackNode() {
-    return nodes_stack_.back();
-}
-
-void Builder::PushNode(std::unique_ptr<json::Node> &&node) {
-    nodes_stack_.emplace_back(std::move(node));
-}
-
-void Builder::PopNode() {
-    nodes_stack_.pop_back();
+    return {KeyPrimary(std::move(key))};
 }
 
 json::Node Builder::Build() {
-    GetState().Build();
-    return root_.value();
-}
-
-void BuilderInitState::Value(json::Node &&node) {
-    builder_.PushBackState(std::make_unique<BuilderValueState>(builder_, json::Node(std::move(node))));
-}
-
-void BuilderInitState::StartDict() {
-    builder_.PushBackState(std::make_unique<BuilderDictState>(builder_));
-}
-
-void BuilderInitState::StartArray() {
-    builder_.PushBackState(std::make_unique<BuilderArrayState>(builder_));
-}
-
-void BuilderInitState::EndDict() {
-    throw std::logic_error("EndDict called in Init state");
-}
-
-void BuilderInitState::EndArray() {
-    throw std::logic_error("EndArray called in Init state");
-}
-
-void BuilderInitState::Key(std::string&&) {
-    throw std::logic_error("Key called in Init state");
-}
-
-void BuilderInitState::Build() {
-    if (builder_.GetNodeStackSize() != 1) {
-        throw std::logic_error("Build called in Init state");
-    } else {
-        builder_.root_ = (*builder_.GetBackNode());
-        builder_.PopNode();
+    if (depth_ != 0 || !root_ready_ || built_) {
+        throw std::logic_error("Unexpected Build call");
     }
+    built_ = true;
+    return std::move(root_);
 }
 
-void BuilderValueState::Value(json::Node&&) {
-    throw std::logic_error("Value called in Value state");
-}
-
-void BuilderValueState::StartDict() {
-    throw std::logic_error("StartDict called in Value state");
-}
-
-void BuilderValueState::StartArray() {
-    throw std::logic_error("StartArray called in Value state");
-}
-
-void BuilderValueState::EndDict() {
-    throw std::logic_error("EndDict called in Value state");
-}
-
-void BuilderValueState::EndArray() {
-    throw std::logic_error("EndArray called in Value state");
-}
-
-void BuilderValueState::Key(std::string&&) {
-    throw std::logic_error("Key called in Value state");
-}
-
-void BuilderValueState::Build() {
-    builder_.root_ = std::move(node_);
-}
-
-void BuilderDictState::Value(json::Node &&node) {
-    if (current_key) {
-        node_.AsDict()[current_key.value()] = json::Node(std::move(node));
-        current_key.reset();
-    } else {
-        throw std::logic_error("Value called without Key in Dict state");
+json::Node& Builder::PlaceForValue(const char *method) {
+    if (depth_ == 0) {
+        if (root_ready_) {
+            throw std::logic_error(method + " called in Value state"s);
+        }
+        root_ready_ = true;
+        return root_;
     }
-}
-
-void BuilderDictState::StartDict() {
-    if (current_key) {
-        builder_.PushBackState(std::make_unique<BuilderDictState>(builder_));
-    } else {
-        throw std::logic_error("Key value not assigned. Unexpected call StartDict");
+    auto &top = TopFrame();
+    switch (top.type) {
+    case FrameType::ARRAY:
+        return top.node->AsArray().emplace_back();
+    case FrameType::DICT_VALUE: {
+        auto &slot = *top.node;
+        PopFrame();
+        return slot;
     }
-}
-
-void BuilderDictState::StartArray() {
-    if (current_key) {
-        builder_.PushBackState(std::make_unique<BuilderArrayState>(builder_));
-    } else {
-        throw std::logic_error("Key value not assigned. Unexpected call StartArray");
+    case FrameType::DICT:
+        break;
     }
+    throw std::logic_error(method + " called without Key in Dict state"s);
 }
 
-void BuilderDictState::EndDict() {
-    builder_.PushNode(std::make_unique<json::Node>(std::move(node_)));
-}
-
-void BuilderDictState::EndArray() {
-    throw std::logic_error("Unexpected call EndArray for Dict state");
-}
-
-void BuilderDictState::Key(std::string &&key) {
-    if (!current_key) {
-        current_key = std::move(key);
-    } else {
-        throw std::logic_error("secondary Key call in Dict state");
+void Builder::CloseContainer(FrameType type, const char *method) {
+    if (depth_ == 0 || TopFrame().type != type) {
+        throw std::logic_error("Unexpected call "s + method);
     }
+    PopFrame();
 }
 
-void BuilderDictState::Build() {
-    throw std::logic_error("Unexpected Build call");
-
-}
-
-void BuilderDictState::ProcessBackNode() {
-    if (current_key) {
-        node_.AsDict()[current_key.value()] = *(builder_.GetBackNode());
-        builder_.PopNode();
-        current_key.reset();
+void Builder::PushFrame(json::Node &node, FrameType type) {
+    if (depth_ < kInlineDepth) {
+        frames_[depth_] = {&node, type};
     } else {
-        throw std::logic_error("Key not ready for value placement in Dict state");
+        overflow_frames_.push_back( {&node, type});
     }
+    ++depth_;
 }
 
-void BuilderArrayState::Value(json::Node &&node) {
-    node_.AsArray().emplace_back(std::move(node));
-}
-
-void BuilderArrayState::StartDict() {
-    builder_.PushBackState(std::make_unique<BuilderDictState>(builder_));
-}
-
-void BuilderArrayState::StartArray() {
-    builder_.PushBackState(std::make_unique<BuilderArrayState>(builder_));
-}
-
-void BuilderArrayState::EndDict() {
-    throw std::logic_error("Unexpected call EndDict for Array state");
-}
-
-void BuilderArrayState::EndArray() {
-    builder_.PushNode(std::make_unique<json::Node>(std::move(node_)));
-}
-
-void BuilderArrayState::Key(std::string&&) {
-    throw std::logic_error("Unexpected call Key for Array state");
-}
-
-void BuilderArrayState::Build() {
-    throw std::logic_error("Unexpected Build call");
+void Builder::PopFrame() {
+    if (depth_ > kInlineDepth) {
+        overflow_frames_.pop_back();
+    }
+    --depth_;
 }
 
-void BuilderArrayState::ProcessBackNode() {
-    node_.AsArray().emplace_back(*builder_.GetBackNode());
-    builder_.PopNode();
+Builder::Frame& Builder::TopFrame() {
+    return depth_ > kInlineDepth ? overflow_frames_.back() : frames_[depth_ - 1];
 }
 
 DictKeyResult DictKeyValueResult::Key(std::string key) {
-    return {builder_.Key(key)};
+    return {builder_.Key(std::move(key))};
 }
 
 Builder& DictKeyValueResult::EndDict() {
@@ -239,7 +121,7 @@ Builder& DictKeyValueResult::EndDict() {
 }
 
 DictKeyValueResult DictKeyResult::Value(json::Node node) {
-    return {builder_.Value(node)};
+    return {builder_.Value(std::move(node))};
 }
 
 StartDictResult DictKeyResult::StartDict() {
@@ -251,7 +133,7 @@ StartArrayResult DictKeyResult::StartArray() {
 }
 
 DictKeyResult StartDictResult::Key(std::string key) {
-    return {builder_.Key(key)};
+    return {builder_.Key(std::move(key))};
 }
 
 Builder& StartDictResult::EndDict() {
@@ -259,7 +141,7 @@ Builder& StartDictResult::EndDict() {
 }
 
 ArrayValueResult StartArrayResult::Value(json::Node node) {
-    return {builder_.Value(node)};
+    return {builder_.Value(std::move(node))};
 }
 
 StartDictResult StartArrayResult::StartDict() {
@@ -275,7 +157,7 @@ Builder& StartArrayResult::EndArray() {
 }
 
 ArrayValueResult ArrayValueResult::Value(json::Node node) {
-    return {builder_.Value(node)};
+    return {builder_.Value(std::move(node))};
 }
 
 StartDictResult ArrayValueResult::StartDict() {
@@ -2,140 +2,30 @@
 #include <string>
 #include <exception>
 #include <vector>
-#include <optional>
-#include <memory>
+#include <array>
 #include "json.h"
 
 namespace json {
 
 /*
- *  For correct control Builder state we use Pattern "State".
+ *  Builder state is encoded in two places:
+ *   - compile time : methods of Builder return context classes (DictKeyResult, StartDictResult ...),
+ *     so only calls allowed in current state can be chained;
+ *   - run time : small inline stack of frames. Every frame points to container (or dict value slot)
+ *     inside the node tree being built, so values are moved directly into their final place.
  *
- *  BiderState contains value - json::Node node_ . This is value for build in current Builder State
+ *  No heap allocation is done by Builder itself (for nesting depth up to kInlineDepth),
+ *  only allocations required for resulting strings and containers.
  */
 
-class Builder;
-
-class BuilderState {
-protected:
-    Builder &builder_;
-    json::Node node_;
-public:
-    BuilderState(Builder &builder) :
-            builder_(builder) {
-    }
-    BuilderState() = delete;
-
-    virtual void Value(json::Node&&) = 0;
-    virtual void StartDict() = 0;
-    virtual void StartArray() = 0;
-    virtual void EndDict() = 0;
-    virtual void EndArray() = 0;
-    virtual void Key(std::string&&) = 0;
-    virtual void Build() = 0;
-    // For Dict and Array State we need to push current node Value to Builder node_stac_ and process it in a new Builder state
-    virtual void ProcessBackNode() {
-    }
-    ;
-
-    json::Node& GetNode() {
-        return node_;
-    }
-    ;
-
-    virtual ~BuilderState() {
-    }
-};
-
-class BuilderInitState: public BuilderState {
-public:
-    BuilderInitState(Builder &builder) :
-            BuilderState(builder) {
-    }
-    BuilderInitState() = delete;
-
-    void Value(json::Node&&) override;
-    void StartDict() override;
-    void StartArray() override;
-    void EndDict() override;
-    void EndArray() override;
-    void Key(std::string&&) override;
-    void Build() override;
-};
-
-class BuilderValueState: public BuilderState {
-public:
-    BuilderValueState(Builder &builder, json::Node &&node) :
-            BuilderState(builder) {
-        node_ = std::move(node);
-    }
-    BuilderValueState() = delete;
-
-    void Value(json::Node&&) override;
-    void StartDict() override;
-    void StartArray() override;
-    void EndDict() override;
-    void EndArray() override;
-    void Key(std::string&&) override;
-    void Build() override;
-};
-
-class BuilderDictState: public BuilderState {
-public:
-    BuilderDictState(Builder &builder) :
-            BuilderState(builder) {
-        this->node_ = json::Dict();
-    }
-    BuilderDictState() = delete;
-
-    void Value(json::Node&&) override;
-    void StartDict() override;
-    void StartArray() override;
-    void EndDict() override;
-    void EndArray() override;
-    void Key(std::string&&) override;
-    void Build() override;
-    void ProcessBackNode() override;
-
-private:
-    std::optional<std::string> current_key;
-};
-
-class BuilderArrayState: public BuilderState {
-public:
-    BuilderArrayState(Builder &builder) :
-            BuilderState(builder) {
-        node_ = json::Array();
-    }
-    BuilderArrayState() = delete;
-
-    void Value(json::Node&&) override;
-    void StartDict() override;
-    void StartArray() override;
-    void EndDict() override;
-    void EndArray() override;
-    void Key(std::string&&) override;
-    void Build() override;
-    void ProcessBackNode() override;
-};
-
-/*
- * Builder
- *
- * */
 class DictKeyResult;
 class StartDictResult;
 class StartArrayResult;
 class ArrayValueResult;
 
 class Builder {
-    friend class BuilderInitState;
-    friend class BuilderValueState;
-    friend class BuilderDictState;
-    friend class BuilderArrayState;
-
 public:
-    Builder();
+    Builder() = default;
 
     Builder& Value(json::Node node);
     StartDictResult StartDict();
@@ -144,24 +34,38 @@ public:
     Builder& EndArray();
     DictKeyResult Key(std::string key);
     Builder& KeyPrimary(std::string key);
+    // moves built node out, builder can't be used after Build
     json::Node Build();
 
-    BuilderState& GetState();
-    void PushBackState(std::unique_ptr<BuilderState> &&state);
-    void PopBackState();
-
-    std::unique_ptr<json::Node>& GetBackNode();
-    void PushNode(std::unique_ptr<json::Node> &&node);
-    void PopNode();
-    size_t GetNodeStackSize() {
-        return nodes_stack_.size();
-    }
-
 private:
-
-    std::optional<json::Node> root_;
-    std::vector<std::unique_ptr<json::Node>> nodes_stack_;
-    std::vector<std::unique_ptr<BuilderState> > state_stack;
+    enum class FrameType {
+        ARRAY, DICT, DICT_VALUE
+    };
+
+    struct Frame {
+        json::Node *node = nullptr;
+        FrameType type = FrameType::ARRAY;
+    };
+
+    static constexpr size_t kInlineDepth = 16;
+
+    // returns place for the next value according to current state
+    json::Node& PlaceForValue(const char *method);
+    // close current container frame
+    void CloseContainer(FrameType type, const char *method);
+
+    void PushFrame(json::Node &node, FrameType type);
+    void PopFrame();
+    Frame& TopFrame();
+
+    json::Node root_;
+    bool root_ready_ = false;
+    bool built_ = false;
+
+    // frames stack : first kInlineDepth frames are stored inline, the rest in overflow vector
+    std::array<Frame, kInlineDepth> frames_;
+    std::vector<Frame> overflow_frames_;
+    size_t depth_ = 0;
 };
 
 class DictKeyValueResult {
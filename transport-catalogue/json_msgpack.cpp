@@ -0,0 +1,319 @@
+/*
+ * json_msgpack.cpp
+ *
+ *  MessagePack compatible binary encoding of json::Node
+ */
+
+#include "json_msgpack.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+
+namespace json {
+
+namespace msgpack {
+
+// cursor over binary message
+class Reader {
+public:
+    explicit Reader(string_view data) :
+            data_(data) {
+    }
+
+    bool AtEnd() const {
+        return pos_ == data_.size();
+    }
+
+    size_t Remaining() const {
+        return data_.size() - pos_;
+    }
+
+    uint8_t Byte() {
+        Require(1);
+        return static_cast<uint8_t>(data_[pos_++]);
+    }
+
+    // read big-endian unsigned integer of size bytes
+    uint64_t BigEndian(size_t size) {
+        Require(size);
+        uint64_t result = 0;
+        for (size_t i = 0; i < size; ++i) {
+            result = (result << 8) | static_cast<uint8_t>(data_[pos_++]);
+        }
+        return result;
+    }
+
+    string_view Bytes(size_t size) {
+        Require(size);
+        auto result = data_.substr(pos_, size);
+        pos_ += size;
+        return result;
+    }
+
+private:
+    void Require(size_t size) const {
+        if (data_.size() - pos_ < size) {
+            throw ParsingError("msgpack parsing error : unexpected end of message");
+        }
+    }
+
+    string_view data_;
+    size_t pos_ = 0;
+};
+
+Node LoadNode(Reader &reader);
+
+Node LoadInt(int64_t value) {
+    if (value < numeric_limits<int>::min() || value > numeric_limits<int>::max()) {
+        throw ParsingError("msgpack parsing error : integer out of int range");
+    }
+    return Node(static_cast<int>(value));
+}
+
+Node LoadUInt(uint64_t value) {
+    if (value > static_cast<uint64_t>(numeric_limits<int>::max())) {
+        throw ParsingError("msgpack parsing error : integer out of int range");
+    }
+    return Node(static_cast<int>(value));
+}
+
+Node LoadString(Reader &reader, size_t size) {
+    return Node(string(reader.Bytes(size)));
+}
+
+Node LoadArray(Reader &reader, size_t size) {
+    Array result;
+    // size comes from message, every element takes at least one byte
+    result.reserve(min(size, reader.Remaining()));
+    for (size_t i = 0; i < size; ++i) {
+        result.emplace_back(LoadNode(reader));
+    }
+    return Node(move(result));
+}
+
+Node LoadDict(Reader &reader, size_t size) {
+    Dict result;
+    for (size_t i = 0; i < size; ++i) {
+        Node key = LoadNode(reader);
+        if (!key.IsString()) {
+            throw ParsingError("msgpack parsing error : map key must be string");
+        }
+        // first key wins as in json::Load
+        result.emplace(key.AsString(), LoadNode(reader));
+    }
+    return Node(move(result));
+}
+
+Node LoadNode(Reader &reader) {
+    uint8_t tag = reader.Byte();
+
+    if (tag <= 0x7f) { // positive fixint
+        return Node(static_cast<int>(tag));
+    } else if (tag >= 0xe0) { // negative fixint
+        return Node(static_cast<int>(static_cast<int8_t>(tag)));
+    } else if ((tag & 0xe0) == 0xa0) { // fixstr
+        return LoadString(reader, tag & 0x1f);
+    } else if ((tag & 0xf0) == 0x90) { // fixarray
+        return LoadArray(reader, tag & 0x0f);
+    } else if ((tag & 0xf0) == 0x80) { // fixmap
+        return LoadDict(reader, tag & 0x0f);
+    }
+
+    switch (tag) {
+    case 0xc0:
+        return Node(nullptr);
+    case 0xc2:
+        return Node(false);
+    case 0xc3:
+        return Node(true);
+    case 0xca: {
+        uint32_t bits = reader.BigEndian(4);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return Node(static_cast<double>(value));
+    }
+    case 0xcb: {
+        uint64_t bits = reader.BigEndian(8);
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return Node(value);
+    }
+    case 0xcc:
+        return LoadUInt(reader.BigEndian(1));
+    case 0xcd:
+        return LoadUInt(reader.BigEndian(2));
+    case 0xce:
+        return LoadUInt(reader.BigEndian(4));
+    case 0xcf:
+        return LoadUInt(reader.BigEndian(8));
+    case 0xd0:
+        return LoadInt(static_cast<int8_t>(reader.BigEndian(1)));
+    case 0xd1:
+        return LoadInt(static_cast<int16_t>(reader.BigEndian(2)));
+    case 0xd2:
+        return LoadInt(static_cast<int32_t>(reader.BigEndian(4)));
+    case 0xd3:
+        return LoadInt(static_cast<int64_t>(reader.BigEndian(8)));
+    case 0xd9:
+        return LoadString(reader, reader.BigEndian(1));
+    case 0xda:
+        return LoadString(reader, reader.BigEndian(2));
+    case 0xdb:
+        return LoadString(reader, reader.BigEndian(4));
+    case 0xdc:
+        return LoadArray(reader, reader.BigEndian(2));
+    case 0xdd:
+        return LoadArray(reader, reader.BigEndian(4));
+    case 0xde:
+        return LoadDict(reader, reader.BigEndian(2));
+    case 0xdf:
+        return LoadDict(reader, reader.BigEndian(4));
+    }
+
+    throw ParsingError("msgpack parsing error : unsupported type tag");
+}
+
+Node Load(string_view data) {
+    Reader reader(data);
+    Node result = LoadNode(reader);
+    if (!reader.AtEnd()) {
+        throw ParsingError("msgpack parsing error : extra bytes after value");
+    }
+    return result;
+}
+
+// append tag and big-endian value of size bytes
+void PrintBigEndian(uint8_t tag, uint64_t value, size_t size, string &buffer) {
+    buffer.push_back(static_cast<char>(tag));
+    for (size_t i = size; i > 0; --i) {
+        buffer.push_back(static_cast<char>((value >> ((i - 1) * 8)) & 0xff));
+    }
+}
+
+// append header of sized value (str, array, map) choosing shortest form
+void PrintSizeHeader(uint8_t fix_tag, size_t fix_limit, uint8_t tag8, uint8_t tag16, uint8_t tag32, size_t size,
+        string &buffer) {
+    if (size < fix_limit) {
+        buffer.push_back(static_cast<char>(fix_tag | size));
+    } else if (tag8 != 0 && size <= 0xff) {
+        PrintBigEndian(tag8, size, 1, buffer);
+    } else if (size <= 0xffff) {
+        PrintBigEndian(tag16, size, 2, buffer);
+    } else {
+        PrintBigEndian(tag32, size, 4, buffer);
+    }
+}
+
+void PrintValue(nullptr_t, string &buffer) {
+    buffer.push_back(static_cast<char>(0xc0));
+}
+
+void PrintValue(bool value, string &buffer) {
+    buffer.push_back(static_cast<char>(value ? 0xc3 : 0xc2));
+}
+
+void PrintValue(int value, string &buffer) {
+    if (value >= 0 && value <= 0x7f) {
+        buffer.push_back(static_cast<char>(value));
+    } else if (value < 0 && value >= -32) {
+        buffer.push_back(static_cast<char>(static_cast<int8_t>(value)));
+    } else if (value >= 0) {
+        if (value <= 0xff) {
+            PrintBigEndian(0xcc, value, 1, buffer);
+        } else if (value <= 0xffff) {
+            PrintBigEndian(0xcd, value, 2, buffer);
+        } else {
+            PrintBigEndian(0xce, value, 4, buffer);
+        }
+    } else {
+        if (value >= numeric_limits<int8_t>::min()) {
+            PrintBigEndian(0xd0, static_cast<uint8_t>(value), 1, buffer);
+        } else if (value >= numeric_limits<int16_t>::min()) {
+            PrintBigEndian(0xd1, static_cast<uint16_t>(value), 2, buffer);
+        } else {
+            PrintBigEndian(0xd2, static_cast<uint32_t>(value), 4, buffer);
+        }
+    }
+}
+
+void PrintValue(double value, string &buffer) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    PrintBigEndian(0xcb, bits, 8, buffer);
+}
+
+void PrintValue(const string &value, string &buffer) {
+    PrintSizeHeader(0xa0, 32, 0xd9, 0xda, 0xdb, value.size(), buffer);
+    buffer.append(value);
+}
+
+void PrintValue(const EscapedString &value, string &buffer) {
+    PrintValue(value.Unescape(), buffer);
+}
+
+void PrintValue(const Array &value, string &buffer) {
+    PrintSizeHeader(0x90, 16, 0, 0xdc, 0xdd, value.size(), buffer);
+    for (const auto &node : value) {
+        Print(node, buffer);
+    }
+}
+
+void PrintValue(const Dict &value, string &buffer) {
+    PrintSizeHeader(0x80, 16, 0, 0xde, 0xdf, value.size(), buffer);
+    for (const auto& [key, node] : value) {
+        PrintValue(key, buffer);
+        Print(node, buffer);
+    }
+}
+
+void Print(const Node &node, string &buffer) {
+    std::visit([&buffer](const auto &value) {
+        PrintValue(value, buffer);
+    }, node.GetValue());
+}
+
+optional<Node> ReadFrame(istream &input) {
+    char header[4];
+    input.read(header, sizeof(header));
+    if (input.gcount() == 0 && input.eof()) {
+        return nullopt;
+    }
+    if (input.gcount() != sizeof(header)) {
+        throw ParsingError("msgpack frame error : incomplete length prefix");
+    }
+    uint32_t size = 0;
+    for (char ch : header) {
+        size = (size << 8) | static_cast<uint8_t>(ch);
+    }
+    if (size > MAX_FRAME_SIZE) {
+        // skip payload to keep next frames readable
+        input.ignore(size);
+        throw ParsingError("msgpack frame error : frame is too long");
+    }
+
+    string payload(size, '\0');
+    input.read(payload.data(), size);
+    if (static_cast<uint32_t>(input.gcount()) != size) {
+        throw ParsingError("msgpack frame error : incomplete frame payload");
+    }
+    return Load(payload);
+}
+
+void WriteFrame(const Node &node, ostream &output) {
+    // reserve place for length prefix and fill it after encoding
+    string buffer(4, '\0');
+    Print(node, buffer);
+    uint32_t size = buffer.size() - 4;
+    for (size_t i = 0; i < 4; ++i) {
+        buffer[i] = static_cast<char>((size >> ((3 - i) * 8)) & 0xff);
+    }
+    output.write(buffer.data(), buffer.size());
+    output.flush();
+}
+
+} // namespace msgpack
+
+} // namespace json
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "json.h"
+
+namespace json {
+
+/*
+ *  Binary encoding of json::Node - MessagePack compatible subset:
+ *   nil, false/true, positive/negative fixint, int8..int64, uint8..uint64 (must fit into int),
+ *   float32/float64, fixstr/str8/str16/str32, fixarray/array16/array32, fixmap/map16/map32 (string keys).
+ *  bin, ext and timestamp types are not supported and cause ParsingError.
+ *
+ *  Framing: every message is prefixed by its length in bytes as 4-byte big-endian unsigned integer.
+ *  Frame length is limited by MAX_FRAME_SIZE.
+ */
+namespace msgpack {
+
+// decode MessagePack value, data must contain exactly one value
+Node Load(std::string_view data);
+
+// encode node as MessagePack value into buffer
+void Print(const Node &node, std::string &buffer);
+
+// max payload size of input frame
+constexpr uint32_t MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+// read one length-prefixed frame, returns std::nullopt on clean end of input.
+// broken or too long frame causes ParsingError, the next frame can still be read
+std::optional<Node> ReadFrame(std::istream &input);
+
+// write node as one length-prefixed frame
+void WriteFrame(const Node &node, std::ostream &output);
+
+} // namespace msgpack
+
+} // namespace json
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <memory>
+#include <sstream>
 #include "json_reader.h"
 
 using namespace std::literals;
@@ -5,68 +8,101 @@ using namespace std::literals;
 namespace tc {
 
 namespace reader {
-json::Document Json::read_config(tc::TransportCatalogue &catalog, std::istream &input) const {
-    json::Document jdoc = json::Load(input);
 
-    LoadStops(jdoc, catalog);
-    LoadBuses(jdoc, catalog);
+// minimal number of base_requests elements processed by one thread
+const size_t MIN_CHUNK_SIZE = 256;
+
+json::LazyDocument Json::read_config(tc::TransportCatalogue &catalog, std::istream &input) const {
+    json::LazyDocument jdoc = json::LoadLazy(input);
+
+    LoadBaseRequests(jdoc, catalog);
 
     return jdoc;
 }
 
-json::Document Json::read_config(tc::TransportCatalogue &catalog, tc::renderer::Map &renderer,
+json::LazyDocument Json::read_config(tc::TransportCatalogue &catalog, tc::renderer::Map &renderer,
         std::istream &input) const {
-    json::Document jdoc = json::Load(input);
-
-    LoadStops(jdoc, catalog);
-    LoadBuses(jdoc, catalog);
-    LoadRendererSettins(jdoc, renderer);
+    json::LazyDocument jdoc = read_config(catalog, input);
+
+    if (jdoc.HasSection("render_settings"s)) {
+        // renderer keeps only raw text of its section and parses it on first map rendering
+        renderer.SetSettingsLoader([reader = *this, text = std::string(jdoc.GetSectionText("render_settings"s))]() {
+            std::istringstream input(text);
+            return reader.LoadRendererSettins(json::Load(input).GetRoot());
+        });
+    }
 
     return jdoc;
 }
 
-void Json::LoadBuses(const json::Document &doc, tc::TransportCatalogue &catalog) const {
-    const auto &root = doc.GetRoot();
-
-    if (auto search = root.AsDict().find("base_requests"s); search != root.AsDict().end()) {
-        const auto &base_requests = search->second;
-        // all Bus stops added to catalog
-        // now we need to add all busses from string buffer
-        for (const auto &element : base_requests.AsArray()) {
-            if (element.AsDict().at("type"s) == "Bus"s) {
-                catalog.AddBus(LoadBus(element, catalog));
-            }
-        }
-
-    } else {
+void Json::LoadBaseRequests(const json::LazyDocument &doc, tc::TransportCatalogue &catalog) const {
+    if (!doc.HasSection("base_requests"s)) {
         throw JsonError("\"base_requests\" not found in json config"s);
     }
+    // base_requests is parsed by chunks, the section itself is never parsed as a whole
+    const auto elements = json::SplitArray(doc.GetSectionText("base_requests"s));
+    const auto ranges = detail::SplitRange(elements.size(), threads_, MIN_CHUNK_SIZE);
+    // caller thread processes the first chunk, pool lives while base_requests are loaded
+    std::unique_ptr<detail::ThreadPool> pool;
+    if (ranges.size() > 1) {
+        pool = std::make_unique<detail::ThreadPool>(ranges.size() - 1);
+    }
 
-}
-
-void Json::LoadStops(const json::Document &doc, tc::TransportCatalogue &catalog) const {
-    const auto &root = doc.GetRoot();
-
-    if (auto search = root.AsDict().find("base_requests"s); search != root.AsDict().end()) {
-        const auto &base_requests = search->second;
-        // distances info for all bus stops
-        tc::DistanceInfoVector distances; // vector of pairs <name, distance_dinfo >
-
-        // find bus stops and add to catalog
-        for (const auto &element : base_requests.AsArray()) {
-            if (element.AsDict().at("type"s) == "Stop"s) {
-                catalog.AddBusStop(LoadBusStop(element, distances));
-            }
+    // parse elements and convert bus stops
+    auto chunks = detail::ParallelMap(ranges, [this, &elements](size_t begin, size_t end) {
+        if (begin == end) {
+            return BaseRequestsChunk { };
+        }
+        const char *text_begin = elements[begin].data();
+        const char *text_end = elements[end - 1].data() + elements[end - 1].size();
+        return LoadBaseRequestsChunk(std::string_view(text_begin, text_end - text_begin));
+    }, pool.get());
+
+    // add bus stops in document order
+    for (auto &chunk : chunks) {
+        for (auto &stop : chunk.stops) {
+            catalog.AddBusStop(std::move(stop));
         }
-        // add distance information to catalog
-        for (const auto& [name, distance_info] : distances) {
+    }
+    // add distance information to catalog
+    for (const auto &chunk : chunks) {
+        for (const auto& [name, distance_info] : chunk.distances) {
             catalog.SetSegmentDistance(name, distance_info.destination, distance_info.distance);
         }
+    }
 
-    } else {
-        throw JsonError("\"base_requests\" not found in json config"s);
+    // all Bus stops added to catalog, convert buses with read only access to catalog
+    const auto &const_catalog = catalog;
+    auto buses = detail::ParallelMap(detail::SplitRange(chunks.size(), chunks.size()),
+            [this, &chunks, &const_catalog](size_t begin, size_t end) {
+                std::vector<tc::Bus> result;
+                for (size_t i = begin; i < end; ++i) {
+                    for (const auto &element : chunks[i].buses) {
+                        result.push_back(LoadBus(element, const_catalog));
+                    }
+                }
+                return result;
+            }, pool.get());
+
+    // add buses in document order
+    for (auto &chunk_buses : buses) {
+        for (auto &bus : chunk_buses) {
+            catalog.AddBus(std::move(bus));
+        }
     }
+}
 
+Json::BaseRequestsChunk Json::LoadBaseRequestsChunk(std::string_view elements_text) const {
+    BaseRequestsChunk result;
+    for (auto &element : json::LoadArrayElements(elements_text)) {
+        const auto &type = element.AsDict().at("type"s);
+        if (type == "Stop"s) {
+            result.stops.push_back(LoadBusStop(element, result.distances));
+        } else if (type == "Bus"s) {
+            result.buses.push_back(std::move(element));
+        }
+    }
+    return result;
 }
 
 tc::BusStop Json::LoadBusStop(const json::Node &node, tc::DistanceInfoVector &distances) const {
@@ -91,7 +127,7 @@ tc::BusStop Json::LoadBusStop(const json::Node &node, tc::DistanceInfoVector &di
     return {name_start, {latitude, longitude}};
 }
 
-tc::Bus Json::LoadBus(const json::Node &node, tc::TransportCatalogue &catalog) const {
+tc::Bus Json::LoadBus(const json::Node &node, const tc::TransportCatalogue &catalog) const {
     auto name = node.AsDict().at("name"s).AsString();
     tc::Bus bus(name);
 
@@ -108,27 +144,37 @@ tc::Bus Json::LoadBus(const json::Node &node, tc::TransportCatalogue &catalog) c
     return bus;
 }
 
-void Json::LoadRendererSettins(const json::Document &doc, renderer::Map &renderer) const {
-    auto config = doc.GetRoot().AsDict();
-    if (auto search = config.find("render_settings"s); search != config.end()) {
-        auto &config_map = search->second;
-        renderer::Settings settings;
-        settings.width = config_map.AsDict().at("width"s).AsDouble();
-        settings.height = config_map.AsDict().at("height"s).AsDouble();
-        settings.padding = config_map.AsDict().at("padding"s).AsDouble();
-        settings.line_width = config_map.AsDict().at("line_width"s).AsDouble();
-        settings.stop_radius = config_map.AsDict().at("stop_radius"s).AsDouble();
-        settings.bus_label_font_size = config_map.AsDict().at("bus_label_font_size"s).AsInt();
-        settings.bus_label_offset = LoadPoint(config_map.AsDict().at("bus_label_offset"s));
-        settings.stop_label_font_size = config_map.AsDict().at("stop_label_font_size"s).AsInt();
-        settings.stop_label_offset = LoadPoint(config_map.AsDict().at("stop_label_offset"s));
-        settings.underlayer_color = LoadColor(config_map.AsDict().at("underlayer_color"s));
-        settings.underlayer_width = config_map.AsDict().at("underlayer_width"s).AsDouble();
-        settings.color_palette = LoadColorPalette(config_map.AsDict().at("color_palette"s));
-
-        renderer.SetSettings(settings);
-
+renderer::Settings Json::LoadRendererSettins(const json::Node &config_map) const {
+    renderer::Settings settings;
+    settings.width = config_map.AsDict().at("width"s).AsDouble();
+    settings.height = config_map.AsDict().at("height"s).AsDouble();
+    settings.padding = config_map.AsDict().at("padding"s).AsDouble();
+    settings.line_width = config_map.AsDict().at("line_width"s).AsDouble();
+    settings.stop_radius = config_map.AsDict().at("stop_radius"s).AsDouble();
+    settings.bus_label_font_size = config_map.AsDict().at("bus_label_font_size"s).AsInt();
+    settings.bus_label_offset = LoadPoint(config_map.AsDict().at("bus_label_offset"s));
+    settings.stop_label_font_size = config_map.AsDict().at("stop_label_font_size"s).AsInt();
+    settings.stop_label_offset = LoadPoint(config_map.AsDict().at("stop_label_offset"s));
+    settings.underlayer_color = LoadColor(config_map.AsDict().at("underlayer_color"s));
+    settings.underlayer_width = config_map.AsDict().at("underlayer_width"s).AsDouble();
+    settings.color_palette = LoadColorPalette(config_map.AsDict().at("color_palette"s));
+    // optional significant digits of numbers in svg output
+    if (auto search = config_map.AsDict().find("precision"s); search != config_map.AsDict().end()) {
+        settings.precision = search->second.AsInt();
+    }
+    // optional polylines simplification tolerance, pixels
+    if (auto search = config_map.AsDict().find("simplify_tolerance"s); search != config_map.AsDict().end()) {
+        settings.simplify_tolerance = search->second.AsDouble();
     }
+    // optional compact svg output
+    if (auto search = config_map.AsDict().find("compact"s); search != config_map.AsDict().end()) {
+        settings.compact = search->second.AsBool();
+    }
+    if (auto search = config_map.AsDict().find("compact_decimals"s); search != config_map.AsDict().end()) {
+        settings.compact_decimals = std::clamp(search->second.AsInt(), 0, svg::PackedDocument::MAX_COMPACT_DECIMALS);
+    }
+
+    return settings;
 }
 
 svg::Point Json::LoadPoint(const json::Node &node) const {
@@ -154,7 +200,7 @@ svg::Color Json::LoadColor(const json::Node &node) const {
 
 std::vector<svg::Color> Json::LoadColorPalette(const json::Node &node) const {
     std::vector<svg::Color> result;
-    for (const auto color_node : node.AsArray()) {
+    for (const auto &color_node : node.AsArray()) {
         result.emplace_back(LoadColor(color_node));
     }
     return result;
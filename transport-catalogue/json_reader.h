@@ -5,6 +5,7 @@
 #include "map_renderer.h"
 #include "transport_catalogue.h"
 #include "domain.h"
+#include "parallel.h"
 
 namespace tc {
 
@@ -21,31 +22,49 @@ public:
 
 class Json {
 public:
+    // threads - number of threads used for base_requests loading
+    explicit Json(size_t threads = detail::DefaultThreadsNumber()) :
+            threads_(threads) {
+    }
+
     // reads configuration from JSON formatted stream
-    // returns json::Document
-    json::Document read_config(tc::TransportCatalogue &catalog, std::istream &input) const;
+    // returns json::LazyDocument, "base_requests" section is loaded by chunks and is not kept parsed
+    json::LazyDocument read_config(tc::TransportCatalogue &catalog, std::istream &input) const;
 
-    // reads configuration from JSON formatted stream , loads configuration in renderer
-    // returns json::Document
-    json::Document read_config(tc::TransportCatalogue &catalog, tc::renderer::Map &renderer, std::istream &input) const;
+    // reads configuration from JSON formatted stream , binds "render_settings" section to renderer.
+    // render settings are parsed on first map rendering only
+    // returns json::LazyDocument
+    json::LazyDocument read_config(tc::TransportCatalogue &catalog, tc::renderer::Map &renderer,
+            std::istream &input) const;
 
 private:
-    // load buses into catalog
-    void LoadBuses(const json::Document &doc, tc::TransportCatalogue &catalog) const;
-    // load bus stops into catalog
-    void LoadStops(const json::Document &doc, tc::TransportCatalogue &catalog) const;
+    // parsed chunk of "base_requests" array
+    struct BaseRequestsChunk {
+        std::vector<tc::BusStop> stops;
+        tc::DistanceInfoVector distances;
+        json::Array buses;
+    };
+
+    // load bus stops and buses from "base_requests" section into catalog.
+    // chunks of array are parsed and converted in parallel, catalog is filled in document order:
+    // stops first, then distances, then buses
+    void LoadBaseRequests(const json::LazyDocument &doc, tc::TransportCatalogue &catalog) const;
+    // parse chunk of base_requests elements and convert bus stops
+    BaseRequestsChunk LoadBaseRequestsChunk(std::string_view elements_text) const;
     // load one bus stop into catalog
     tc::BusStop LoadBusStop(const json::Node &node, tc::DistanceInfoVector &distances) const;
     // load one bus into catalog
-    tc::Bus LoadBus(const json::Node &node, tc::TransportCatalogue &catalog) const;
-    // load renderer settings
-    void LoadRendererSettins(const json::Document &doc, renderer::Map &renderer) const;
+    tc::Bus LoadBus(const json::Node &node, const tc::TransportCatalogue &catalog) const;
+    // load renderer settings from "render_settings" section
+    renderer::Settings LoadRendererSettins(const json::Node &config_map) const;
     // load Point
     svg::Point LoadPoint(const json::Node &node) const;
     //
     svg::Color LoadColor(const json::Node &node) const;
 
     std::vector<svg::Color> LoadColorPalette(const json::Node &node) const;
+
+    size_t threads_;
 };
 
 } //namespace reader
@@ -6,25 +6,109 @@
 // Description : Hello World in C++, Ansi-style
 //============================================================================
 
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
+#include "catalogue_image.h"
+#include "catalogue_registry.h"
 #include "json.h"
+#include "json_msgpack.h"
 #include "json_reader.h"
 #include "map_renderer.h"
 #include "request_handler.h"
+#include "request_pipeline.h"
+#include "request_server.h"
+#include "request_workers.h"
 #include "transport_catalogue.h"
 
 using namespace std;
 
-int main() {
+// command line options
+struct Options {
+    // MessagePack mode configuration file, empty - JSON batch mode
+    string msgpack_config;
+    // server mode configuration file
+    string serve_config;
+    // regions mode: pairs of region name and configuration file
+    vector<pair<string, string>> regions;
+    // server mode unix domain socket path, empty - serve stdin/stdout
+    string socket_path;
+    // server mode worker processes sharing catalog image, 0 - serve in loader process
+    size_t workers = 0;
+    // number of threads for stat requests execution
+    size_t threads = 1;
+    // JSON batch mode uses staged parse -> execute -> serialize pipeline
+    bool pipeline = false;
+};
+
+optional<Options> ParseOptions(int argc, char *argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        string_view arg = argv[i];
+        if (arg == "--msgpack"sv && i + 1 < argc) {
+            options.msgpack_config = argv[++i];
+        } else if (arg == "--serve"sv && i + 1 < argc) {
+            options.serve_config = argv[++i];
+        } else if (arg == "--socket"sv && i + 1 < argc) {
+            options.socket_path = argv[++i];
+        } else if (arg == "--region"sv && i + 1 < argc) {
+            string_view region = argv[++i];
+            auto pos = region.find('=');
+            if (pos == 0 || pos == string_view::npos || pos + 1 == region.size()) {
+                return nullopt;
+            }
+            options.regions.emplace_back(region.substr(0, pos), region.substr(pos + 1));
+        } else if (arg == "--pipeline"sv) {
+            options.pipeline = true;
+        } else if (arg == "--workers"sv && i + 1 < argc) {
+            int workers = atoi(argv[++i]);
+            if (workers < 1) {
+                return nullopt;
+            }
+            options.workers = workers;
+        } else if (arg == "--threads"sv && i + 1 < argc) {
+            int threads = atoi(argv[++i]);
+            if (threads < 1) {
+                return nullopt;
+            }
+            options.threads = threads;
+        } else {
+            return nullopt;
+        }
+    }
+    // only one mode can be selected, socket is used by server mode only
+    int modes = !options.msgpack_config.empty() + !options.serve_config.empty() + !options.regions.empty();
+    if (modes > 1
+            || (!options.socket_path.empty() && options.serve_config.empty())
+            || (options.workers > 0 && options.socket_path.empty())) {
+        return nullopt;
+    }
+    return options;
+}
+
+// batch mode: JSON configuration with stat_requests from stdin, JSON results to stdout
+int RunJson(const Options &options) {
 
     tc::TransportCatalogue catalog;
     tc::reader::Json config_reader;
     tc::renderer::Map map_renderer;
-    // read configuration for catalog and renderer and returns full json configuration document
-    json::Document jdoc = config_reader.read_config(catalog, map_renderer, cin);
+    // read configuration for catalog and renderer and returns lazy json configuration document
+    json::LazyDocument jdoc = config_reader.read_config(catalog, map_renderer, cin);
 
-    tc::handler::RequestHandler handler;
+    tc::handler::RequestHandler handler(options.threads);
+    if (options.pipeline) {
+        // stat_requests are parsed, handled and printed by chunks concurrently
+        tc::handler::Pipeline pipeline(handler);
+        pipeline.Run(catalog, map_renderer, jdoc.GetSectionText("stat_requests"s), cout);
+        return 0;
+    }
     // handle requests from configuration document
     json::Document results = handler.HandleQueries(catalog, jdoc, map_renderer);
 
@@ -32,3 +116,142 @@ int main() {
 
     return 0;
 }
+
+// binary mode: JSON configuration from file,
+// stdin - length-prefixed MessagePack frames, every frame is an array of stat requests
+// stdout - one length-prefixed MessagePack frame with results array per input frame
+int RunMsgpack(const Options &options) {
+    ifstream config(options.msgpack_config);
+    if (!config) {
+        cerr << "can't open configuration file "sv << options.msgpack_config << endl;
+        return 1;
+    }
+
+    tc::TransportCatalogue catalog;
+    tc::reader::Json config_reader;
+    tc::renderer::Map map_renderer;
+    json::LazyDocument jdoc = config_reader.read_config(catalog, map_renderer, config);
+
+    tc::handler::RequestHandler handler(options.threads);
+    while (true) {
+        json::Node answer;
+        try {
+            auto frame = json::msgpack::ReadFrame(cin);
+            if (!frame) {
+                break;
+            }
+            answer = move(handler.HandleQueries(catalog, frame->AsArray(), map_renderer).GetRoot());
+        } catch (const exception &e) {
+            // broken frame gets error answer, the next frames are still served
+            answer = json::Dict { { "error_message"s, string(e.what()) } };
+        }
+        json::msgpack::WriteFrame(answer, cout);
+    }
+
+    return 0;
+}
+
+// server mode with worker processes: catalog image with rendered map is built once,
+// worker processes serve unix domain socket from the image in shared memory
+int RunWorkers(const Options &options, istream &config) {
+    string image;
+    {
+        // catalog is released before workers are forked
+        tc::TransportCatalogue catalog;
+        tc::reader::Json config_reader;
+        tc::renderer::Map map_renderer;
+        json::LazyDocument jdoc = config_reader.read_config(catalog, map_renderer, config);
+
+        tc::handler::RequestHandler handler;
+        ostringstream out;
+        handler.RenderBusRoutesMap(catalog, map_renderer, out);
+        const string map = move(out).str();
+        image = tc::CatalogueImage::Build(catalog, &map);
+    }
+
+    try {
+        tc::handler::WorkerPool pool(image);
+        image = string();
+        return pool.Run(options.socket_path, options.workers);
+    } catch (const runtime_error &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+}
+
+// server mode: JSON configuration from file is loaded once,
+// then newline-delimited JSON stat requests are served from stdin/stdout or unix domain socket
+int RunServer(const Options &options) {
+    ifstream config(options.serve_config);
+    if (!config) {
+        cerr << "can't open configuration file "sv << options.serve_config << endl;
+        return 1;
+    }
+
+    if (options.workers > 0) {
+        return RunWorkers(options, config);
+    }
+
+    tc::TransportCatalogue catalog;
+    tc::reader::Json config_reader;
+    tc::renderer::Map map_renderer;
+    json::LazyDocument jdoc = config_reader.read_config(catalog, map_renderer, config);
+
+    tc::handler::RequestHandler handler(options.threads);
+    tc::handler::Server server(catalog, map_renderer, handler);
+    if (!options.socket_path.empty()) {
+        server.ServeUnixSocket(options.socket_path);
+        return 1;
+    }
+
+    // pipelined requests are detected by buffered input data
+    ios::sync_with_stdio(false);
+    server.Serve(cin, cout);
+
+    return 0;
+}
+
+// regions mode: every region catalog is loaded from own configuration file,
+// stat_requests from stdin are routed to regions by "region" key, JSON results to stdout
+int RunRegions(const Options &options) {
+    tc::handler::CatalogueRegistry registry(options.threads);
+    try {
+        registry.LoadFiles(options.regions);
+    } catch (const invalid_argument &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    json::LazyDocument jdoc = json::LoadLazy(cin);
+    json::Print(registry.HandleQueries(jdoc), cout);
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    // mode switch: no mode options - JSON batch mode
+    //              --msgpack <config.json> - binary stat requests mode
+    //              --serve <config.json> [--socket <path>] - server mode
+    //              --workers N - server mode with N worker processes, socket is required
+    //              --region <name>=<config.json> ... - regions mode, option is repeated for every region
+    //              --pipeline - JSON batch mode with concurrent parse, execute and print stages
+    //              --threads N - number of threads for stat requests execution
+    auto options = ParseOptions(argc, argv);
+    if (!options) {
+        cerr << "usage: "sv << argv[0]
+                << " [--msgpack <config.json> | --serve <config.json> [--socket <path> [--workers N]]"sv
+                << " | --region <name>=<config.json> ...]"sv
+                << " [--pipeline] [--threads N]"sv << endl;
+        return 1;
+    }
+    if (!options->msgpack_config.empty()) {
+        return RunMsgpack(*options);
+    }
+    if (!options->serve_config.empty()) {
+        return RunServer(*options);
+    }
+    if (!options->regions.empty()) {
+        return RunRegions(*options);
+    }
+    return RunJson(*options);
+}
@@ -6,7 +6,11 @@
  */
 
 #include "map_renderer.h"
+#include <cstring>
+#include <iterator>
+#include <limits>
 #include <string>
+#include <unordered_set>
 using namespace std::literals;
 
 namespace tc {
@@ -17,91 +21,582 @@ bool IsZero(double value) {
     return std::abs(value) < EPSILON;
 }
 
+std::shared_ptr<const std::string> Map::GetCachedMap(uint64_t data_version) const {
+    if (cached_map_ && cached_map_version_ == data_version) {
+        return cached_map_;
+    }
+    return nullptr;
+}
+
+void Map::SetCachedMap(uint64_t data_version, std::shared_ptr<const std::string> map) {
+    cached_map_ = std::move(map);
+    cached_map_version_ = data_version;
+}
+
+void Map::ResetCachedMap() {
+    cached_map_.reset();
+    layout_.reset();
+    fragments_.clear();
+}
+
+void Map::EnsureSettings() {
+    if (settings_loader_) {
+        settings_ = settings_loader_();
+        settings_loader_ = nullptr;
+    }
+}
+
 void Map::InitProjector(const std::vector<geo::Coordinates> &points) {
-    projector_ = SphereProjector(points.begin(), points.end(), settings_.width, settings_.height, settings_.padding);
+    EnsureSettings();
+    SphereProjector projector(points.begin(), points.end(), settings_.width, settings_.height, settings_.padding);
+    // every object is moved by new projector
+    if (projector != projector_) {
+        fragments_.clear();
+    }
+    projector_ = projector;
+}
+
+void Map::InitDocument(svg::PackedDocument &output) {
+    // style attributes are formatted once for all objects of style
+    const int precision = settings_.precision;
+    // compact label is painted with its underlayer as stroke under fill, underlayer styles are not used
+    const bool compact = settings_.compact;
+    if (compact) {
+        output.SetCompact(settings_.compact_decimals);
+    }
+    styles_.lines.clear();
+    styles_.bus_labels.clear();
+    for (const auto &color : settings_.color_palette) {
+        svg::Polyline line;
+        line.SetStrokeWidth(settings_.line_width).SetStrokeLineCap(svg::StrokeLineCap::ROUND).SetStrokeLineJoin(
+                svg::StrokeLineJoin::ROUND).SetStrokeColor(color);
+        line.SetFillColor(svg::NoneColor);
+        styles_.lines.push_back(output.AddPolylineStyle(std::move(line.FreezeAttrs(precision))));
+
+        svg::Text label;
+        label.SetOffset(settings_.bus_label_offset);
+        label.SetFontSize(settings_.bus_label_font_size);
+        label.SetFontFamily("Verdana"s);
+        label.SetFontWeight("bold"s);
+        if (compact) {
+            SetUnderlayer(label);
+            label.SetPaintOrder("stroke"s);
+        }
+        label.SetFillColor(color);
+        styles_.bus_labels.push_back(output.AddTextStyle(std::move(label.FreezeAttrs(precision))));
+    }
+
+    if (!compact) {
+        svg::Text bus_underlayer;
+        bus_underlayer.SetOffset(settings_.bus_label_offset);
+        bus_underlayer.SetFontSize(settings_.bus_label_font_size);
+        bus_underlayer.SetFontFamily("Verdana"s);
+        bus_underlayer.SetFontWeight("bold"s);
+        SetUnderlayer(bus_underlayer);
+        styles_.bus_label_underlayer = output.AddTextStyle(std::move(bus_underlayer.FreezeAttrs(precision)));
+    }
+
+    svg::Circle stop_point;
+    stop_point.SetRadius(settings_.stop_radius);
+    stop_point.SetFillColor("white"s);
+    styles_.stop_point = output.AddCircleStyle(std::move(stop_point.FreezeAttrs(precision)));
+
+    svg::Text stop_label;
+    stop_label.SetOffset(settings_.stop_label_offset);
+    stop_label.SetFontSize(settings_.stop_label_font_size);
+    stop_label.SetFontFamily("Verdana"s);
+
+    if (compact) {
+        SetUnderlayer(stop_label);
+        stop_label.SetPaintOrder("stroke"s);
+    } else {
+        svg::Text stop_underlayer = stop_label;
+        SetUnderlayer(stop_underlayer);
+        styles_.stop_label_underlayer = output.AddTextStyle(std::move(stop_underlayer.FreezeAttrs(precision)));
+    }
+
+    stop_label.SetFillColor("black"s);
+    styles_.stop_label = output.AddTextStyle(std::move(stop_label.FreezeAttrs(precision)));
+}
+
+void Map::SetUnderlayer(svg::Text &text) const {
+    text.SetFillColor(settings_.underlayer_color);
+    text.SetStrokeColor(settings_.underlayer_color);
+    text.SetStrokeWidth(settings_.underlayer_width);
+    text.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
+    text.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+}
+
+bool Map::HasLayout(uint64_t data_version) const {
+    return layout_ && layout_->version == data_version;
+}
+
+Rect Map::GetLabelBox(svg::Point position, svg::Point offset, int font_size, size_t length) const {
+    // text width is estimated as font size per byte of name, real glyphs are narrower
+    const svg::Point anchor { position.x + offset.x, position.y + offset.y };
+    return Rect { anchor.x, anchor.y - font_size, anchor.x + font_size * static_cast<double>(length), anchor.y
+            + font_size }.Expanded(settings_.underlayer_width);
+}
+
+Rect Map::GetSegmentBox(const std::vector<svg::Point> &positions, const std::vector<uint32_t> &route,
+        size_t segment) {
+    return Rect::Of(positions[route[segment]], positions[route[std::min(segment + 1, route.size() - 1)]]);
+}
+
+// distance from point to segment [from, to]
+static double SegmentDistance(svg::Point point, svg::Point from, svg::Point to) {
+    const double dx = to.x - from.x;
+    const double dy = to.y - from.y;
+    const double length = dx * dx + dy * dy;
+    double t = 0;
+    if (length > 0) {
+        t = std::clamp(((point.x - from.x) * dx + (point.y - from.y) * dy) / length, 0.0, 1.0);
+    }
+    return std::hypot(point.x - from.x - t * dx, point.y - from.y - t * dy);
+}
+
+std::vector<float> Map::SimplifyRoute(const std::vector<svg::Point> &positions, const std::vector<uint32_t> &route) {
+    // significance of point is its distance from line of its Douglas-Peucker range,
+    // limited by significance of range parent, so points of every tolerance form DP simplification
+    const float infinity = std::numeric_limits<float>::infinity();
+    std::vector<float> significance(route.size(), infinity);
+    if (route.size() < 3) {
+        return significance;
+    }
+    auto point = [&positions, &route](size_t index) {
+        return positions[route[index]];
+    };
+
+    struct Range {
+        size_t first;
+        size_t last;
+        float limit;
+    };
+    std::vector<Range> ranges { { 0, route.size() - 1, infinity } };
+    while (!ranges.empty()) {
+        const auto [first, last, limit] = ranges.back();
+        ranges.pop_back();
+        if (last - first < 2) {
+            continue;
+        }
+        size_t farthest = first + 1;
+        double max_distance = -1;
+        for (size_t i = first + 1; i < last; ++i) {
+            if (double distance = SegmentDistance(point(i), point(first), point(last)); distance > max_distance) {
+                max_distance = distance;
+                farthest = i;
+            }
+        }
+        significance[farthest] = std::min(static_cast<float>(max_distance), limit);
+        ranges.push_back( { first, farthest, significance[farthest] });
+        ranges.push_back( { farthest, last, significance[farthest] });
+    }
+    return significance;
+}
+
+// number of polyline segments of route
+static size_t SegmentsCount(size_t route_size) {
+    return route_size == 0 ? 0 : std::max<size_t>(1, route_size - 1);
+}
+
+void Map::SetLayout(uint64_t data_version, MapLayout objects) {
+    IndexedLayout layout;
+    layout.version = data_version;
+
+    // every stop is projected once, map objects refer to stops by index
+    {
+        std::vector<geo::Coordinates> points;
+        points.reserve(objects.stops.size());
+        for (const auto &stop : objects.stops) {
+            points.push_back(stop.position);
+        }
+        InitProjector(points);
+    }
+    layout.positions.reserve(objects.stops.size());
+    for (const auto &stop : objects.stops) {
+        layout.positions.push_back(projector_(stop.position));
+    }
+
+    // indexes cover the whole map and all projected stops
+    Rect bounds { 0, 0, settings_.width, settings_.height };
+    for (const auto &position : layout.positions) {
+        bounds = { std::min(bounds.min_x, position.x), std::min(bounds.min_y, position.y), std::max(bounds.max_x,
+                position.x), std::max(bounds.max_y, position.y) };
+    }
+
+    // labels are indexed by their own boxes, so search area of tile doesn't depend on the longest name.
+    // Label keeps its size in pixels and comes closer to its position at bigger zoom,
+    // so its box on whole map joined with position contains its boxes at all zooms
+    auto label_area = [this](svg::Point position, svg::Point offset, int font_size, size_t length) {
+        const Rect box = GetLabelBox(position, offset, font_size, length);
+        return Rect { std::min(box.min_x, position.x), std::min(box.min_y, position.y), std::max(box.max_x,
+                position.x), std::max(box.max_y, position.y) };
+    };
+    layout.margin = std::max(settings_.stop_radius, settings_.line_width / 2);
+
+    layout.first_segment.reserve(objects.buses.size() + 1);
+    layout.first_segment.push_back(0);
+    for (uint32_t bus = 0; bus < objects.buses.size(); ++bus) {
+        const auto &line = objects.buses[bus];
+        layout.first_segment.push_back(layout.first_segment.back() + SegmentsCount(line.route.size()));
+        for (const auto &terminal : line.terminals) {
+            layout.bus_labels.emplace_back(bus, terminal);
+        }
+    }
+
+    layout.segments = GridIndex(bounds, layout.first_segment.back());
+    for (uint32_t bus = 0; bus < objects.buses.size(); ++bus) {
+        const auto &route = objects.buses[bus].route;
+        for (size_t segment = 0; segment < SegmentsCount(route.size()); ++segment) {
+            layout.segments.Insert(layout.first_segment[bus] + segment, GetSegmentBox(layout.positions, route, segment));
+        }
+    }
+    layout.labels = GridIndex(bounds, layout.bus_labels.size());
+    for (uint32_t label = 0; label < layout.bus_labels.size(); ++label) {
+        const auto [bus, stop] = layout.bus_labels[label];
+        layout.labels.Insert(label, label_area(layout.positions[stop], settings_.bus_label_offset,
+                settings_.bus_label_font_size, objects.buses[bus].name.size()));
+    }
+    layout.stops = GridIndex(bounds, objects.stops.size());
+    for (uint32_t stop = 0; stop < objects.stops.size(); ++stop) {
+        // stop point is found by margin of search area
+        layout.stops.Insert(stop, label_area(layout.positions[stop], settings_.stop_label_offset,
+                settings_.stop_label_font_size, objects.stops[stop].name.size()));
+    }
+
+    // route simplification doesn't depend on zoom, significance of points is compared with scaled tolerance
+    if (settings_.simplify_tolerance > 0) {
+        layout.significance.reserve(objects.buses.size());
+        for (const auto &line : objects.buses) {
+            layout.significance.push_back(SimplifyRoute(layout.positions, line.route));
+        }
+    }
+
+    layout.objects = std::move(objects);
+    layout_ = std::move(layout);
 }
 
-void Map::RenderLine(const std::vector<geo::Coordinates> &points, svg::Document &output) {
-    svg::Polyline poly_line;
-    poly_line.SetStrokeWidth(settings_.line_width).SetStrokeLineCap(svg::StrokeLineCap::ROUND).SetStrokeLineJoin(
-            svg::StrokeLineJoin::ROUND).SetStrokeColor(GetGolorFromPalette());
+void Map::AddLine(const ViewportTransform &transform, size_t bus, size_t first, size_t last,
+        svg::PackedDocument &output) const {
+    const auto &positions = layout_->positions;
+    const auto &route = layout_->objects.buses[bus].route;
+    output.AddPolyline(styles_.lines[bus % styles_.lines.size()]);
+    if (layout_->significance.empty()) {
+        for (size_t point = first; point <= last; ++point) {
+            output.AddPoint(transform(positions[route[point]]));
+        }
+        return;
+    }
+    // tolerance in pixels of whole map
+    const double tolerance = settings_.simplify_tolerance / transform.scale;
+    const auto &significance = layout_->significance[bus];
+    for (size_t point = first; point <= last; ++point) {
+        if (point == first || point == last || significance[point] > tolerance) {
+            output.AddPoint(transform(positions[route[point]]));
+        }
+    }
+}
 
-    poly_line.SetFillColor(svg::NoneColor);
+void Map::AddBusName(svg::Point point, size_t bus, svg::PackedDocument &output) const {
+    const auto name = layout_->objects.buses[bus].name;
+    if (!settings_.compact) {
+        output.AddText(styles_.bus_label_underlayer, point, name);
+    }
+    output.AddText(styles_.bus_labels[bus % styles_.bus_labels.size()], point, name);
+}
 
-    for (const auto &point : points) {
-        poly_line.AddPoint(projector_(point));
+void Map::AddBusStopName(svg::Point point, size_t stop, svg::PackedDocument &output) const {
+    const auto name = layout_->objects.stops[stop].name;
+    if (!settings_.compact) {
+        output.AddText(styles_.stop_label_underlayer, point, name);
     }
-    output.AddPtr(std::make_unique<svg::Polyline>(poly_line));
+    output.AddText(styles_.stop_label, point, name);
 }
 
-void Map::SetNextColor() {
-    current_color = (current_color + 1) % settings_.color_palette.size();
+void Map::RenderLine(size_t bus, svg::PackedDocument &output) const {
+    if (const auto &route = layout_->objects.buses[bus].route; !route.empty()) {
+        AddLine( { }, bus, 0, route.size() - 1, output);
+    }
 }
 
-void Map::RenderBusStopPoint(const geo::Coordinates &point, svg::Document &output) {
-    svg::Circle circle;
-    circle.SetCenter(projector_(point));
-    circle.SetRadius(settings_.stop_radius);
-    circle.SetFillColor("white"s);
+void Map::RenderBusName(size_t bus, svg::PackedDocument &output) const {
+    for (const auto terminal : layout_->objects.buses[bus].terminals) {
+        AddBusName(layout_->positions[terminal], bus, output);
+    }
+}
 
-    output.AddPtr(std::make_unique<svg::Circle>(circle));
+void Map::RenderBusStopPoint(size_t stop, svg::PackedDocument &output) const {
+    output.AddCircle(styles_.stop_point, layout_->positions[stop]);
 }
 
-void Map::RenderBusStopName(const geo::Coordinates &point, const std::string_view &bus_stop_name,
-        svg::Document &output) {
-    svg::Text text;
-    text.SetData(std::string { bus_stop_name });
-    text.SetPosition(projector_(point));
-    text.SetOffset(settings_.stop_label_offset);
-    text.SetFontSize(settings_.stop_label_font_size);
-    text.SetFontFamily("Verdana"s);
+void Map::RenderBusStopName(size_t stop, svg::PackedDocument &output) const {
+    AddBusStopName(layout_->positions[stop], stop, output);
+}
 
-    svg::Text bottom = text;
+void Map::RenderViewport(const Viewport &viewport, svg::PackedDocument &output) const {
+    const auto &layout = *layout_;
+    const auto &objects = layout.objects;
 
-    text.SetFillColor("black"s);
+    // tile is rendered in its own coordinates with map size,
+    // whole map positions are scaled and moved, not projected again
+    const double scale = viewport.GetScale();
+    const svg::Point origin { viewport.x * settings_.width, viewport.y * settings_.height };
+    const ViewportTransform transform { scale, origin };
+    const Rect frame { 0, 0, settings_.width, settings_.height };
+    // tile area on the whole map, objects are searched in it with margin of stop points and lines
+    const Rect area = Rect { origin.x / scale, origin.y / scale, (origin.x + settings_.width) / scale, (origin.y
+            + settings_.height) / scale }.Expanded(layout.margin / scale);
 
-    bottom.SetFillColor(settings_.underlayer_color);
-    bottom.SetStrokeColor(settings_.underlayer_color);
-    bottom.SetStrokeWidth(settings_.underlayer_width);
-    bottom.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
-    bottom.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+    // bus lines: every run of consecutive visible segments of bus is rendered as polyline.
+    // run ends outside of tile, so polyline caps and joins there are invisible
+    const auto segments = layout.segments.Query(area);
+    size_t bus = 0;
+    size_t run_begin = 0;
+    size_t run_end = 0; // last segment id of current run + 1
+    auto render_run = [&]() {
+        if (run_begin == run_end) {
+            return;
+        }
+        const size_t last_point = objects.buses[bus].route.size() - 1;
+        AddLine(transform, bus, run_begin - layout.first_segment[bus],
+                std::min(run_end - layout.first_segment[bus], last_point), output);
+    };
+    for (const auto id : segments) {
+        if (id != run_end || id >= layout.first_segment[bus + 1]) {
+            render_run();
+            while (layout.first_segment[bus + 1] <= id) {
+                ++bus;
+            }
+            run_begin = run_end = id;
+        }
+        const auto &route = objects.buses[bus].route;
+        const size_t segment = id - layout.first_segment[bus];
+        if (frame.Expanded(settings_.line_width / 2).IntersectsSegment(transform(layout.positions[route[segment]]),
+                transform(layout.positions[route[std::min(segment + 1, route.size() - 1)]]))) {
+            ++run_end;
+        } else {
+            render_run();
+            run_begin = run_end = id + 1;
+        }
+    }
+    render_run();
 
-    output.AddPtr(std::make_unique<svg::Text>(bottom));
-    output.AddPtr(std::make_unique<svg::Text>(text));
+    for (const auto id : layout.labels.Query(area)) {
+        const auto [label_bus, stop] = layout.bus_labels[id];
+        const auto point = transform(layout.positions[stop]);
+        if (GetLabelBox(point, settings_.bus_label_offset, settings_.bus_label_font_size,
+                objects.buses[label_bus].name.size()).Intersects(frame)) {
+            AddBusName(point, label_bus, output);
+        }
+    }
 
+    const auto stops = layout.stops.Query(area);
+    for (const auto id : stops) {
+        const auto point = transform(layout.positions[id]);
+        if (Rect::Of(point, point).Expanded(settings_.stop_radius).Intersects(frame)) {
+            output.AddCircle(styles_.stop_point, point);
+        }
+    }
+    for (const auto id : stops) {
+        const auto point = transform(layout.positions[id]);
+        if (GetLabelBox(point, settings_.stop_label_offset, settings_.stop_label_font_size,
+                objects.stops[id].name.size()).Intersects(frame)) {
+            AddBusStopName(point, id, output);
+        }
+    }
+}
+size_t Map::GetObjectsCount(Layer layer) const {
+    switch (layer) {
+    case Layer::BUS_LINES:
+    case Layer::BUS_NAMES:
+        return GetBusesCount();
+    case Layer::STOP_POINTS:
+    case Layer::STOP_NAMES:
+        return GetBusStopsCount();
+    }
+    return 0;
 }
 
-svg::Color Map::GetGolorFromPalette() {
-    return settings_.color_palette[current_color];
+void Map::RenderObject(Layer layer, size_t index, svg::PackedDocument &output) const {
+    switch (layer) {
+    case Layer::BUS_LINES:
+        RenderLine(index, output);
+        break;
+    case Layer::BUS_NAMES:
+        RenderBusName(index, output);
+        break;
+    case Layer::STOP_POINTS:
+        RenderBusStopPoint(index, output);
+        break;
+    case Layer::STOP_NAMES:
+        RenderBusStopName(index, output);
+        break;
+    }
+}
 
+void Map::ReserveObjects(Layer layer, size_t first, size_t last, svg::PackedDocument &output) const {
+    const auto &objects = layout_->objects;
+    // label is rendered with its underlayer text unless underlayer is stroke of compact label
+    const size_t label_texts = settings_.compact ? 1 : 2;
+    size_t circles = 0;
+    size_t polylines = 0;
+    size_t texts = 0;
+    size_t points = 0;
+    size_t chars = 0;
+    for (size_t i = first; i < last; ++i) {
+        switch (layer) {
+        case Layer::BUS_LINES:
+            polylines += 1;
+            points += objects.buses[i].route.size();
+            break;
+        case Layer::BUS_NAMES:
+            texts += label_texts * objects.buses[i].terminals.size();
+            chars += label_texts * objects.buses[i].terminals.size() * objects.buses[i].name.size();
+            break;
+        case Layer::STOP_POINTS:
+            circles += 1;
+            break;
+        case Layer::STOP_NAMES:
+            texts += label_texts;
+            chars += label_texts * objects.stops[i].name.size();
+            break;
+        }
+    }
+    output.Reserve(circles, polylines, texts, points, chars);
 }
 
-void Map::RenderBusName(const geo::Coordinates &point, const std::string_view &bus_name, svg::Document &output) {
+// FragmentHasher - two independent 64-bit hashes and length of values sequence
+class FragmentHasher {
+public:
+    FragmentHasher& Add(uint64_t value) {
+        return Combine(value, value);
+    }
+    FragmentHasher& Add(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return Add(bits);
+    }
+    FragmentHasher& Add(std::string_view value) {
+        // check hash of string doesn't depend on std::hash
+        uint64_t fnv = 0xcbf29ce484222325ULL;
+        for (const char ch : value) {
+            fnv = (fnv ^ static_cast<uint8_t>(ch)) * 0x100000001b3ULL;
+        }
+        return Add(static_cast<uint64_t>(value.size())).Combine(std::hash<std::string_view> { }(value), fnv);
+    }
+    FragmentHasher& Add(svg::Point value) {
+        return Add(value.x).Add(value.y);
+    }
+    FragmentKey Get() const {
+        return {hash_, check_, length_};
+    }
 
-    svg::Text text;
-    text.SetData(std::string { bus_name });
-    text.SetPosition(projector_(point));
-    text.SetOffset(settings_.bus_label_offset);
-    text.SetFontSize(settings_.bus_label_font_size);
-    text.SetFontFamily("Verdana"s);
-    text.SetFontWeight("bold"s);
+private:
+    FragmentHasher& Combine(uint64_t hash_value, uint64_t check_value) {
+        hash_ = SplitMix(hash_ ^ SplitMix(hash_value));
+        check_ = MurmurMix(check_ * 0x9e3779b97f4a7c15ULL + check_value);
+        ++length_;
+        return *this;
+    }
 
-    svg::Text bottom = text;
+    // splitmix64 finalizer
+    static uint64_t SplitMix(uint64_t value) {
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31);
+    }
+    // murmur3 fmix64 finalizer
+    static uint64_t MurmurMix(uint64_t value) {
+        value = (value ^ (value >> 33)) * 0xff51afd7ed558ccdULL;
+        value = (value ^ (value >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+        return value ^ (value >> 33);
+    }
 
-    text.SetFillColor(GetGolorFromPalette());
+    uint64_t hash_ = 0;
+    uint64_t check_ = 0;
+    uint64_t length_ = 0;
+};
 
-    bottom.SetFillColor(settings_.underlayer_color);
-    bottom.SetStrokeColor(settings_.underlayer_color);
-    bottom.SetStrokeWidth(settings_.underlayer_width);
-    bottom.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
-    bottom.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+FragmentKey Map::GetFragmentKey(Layer layer, size_t index) const {
+    const auto &objects = layout_->objects;
+    const auto &positions = layout_->positions;
+    FragmentHasher hasher;
+    hasher.Add(static_cast<uint64_t>(layer));
+    switch (layer) {
+    case Layer::BUS_LINES: {
+        // bus name is not rendered in line
+        hasher.Add(static_cast<uint64_t>(index % styles_.lines.size()));
+        for (const auto stop : objects.buses[index].route) {
+            hasher.Add(positions[stop]);
+        }
+        break;
+    }
+    case Layer::BUS_NAMES:
+        hasher.Add(static_cast<uint64_t>(index % styles_.bus_labels.size())).Add(objects.buses[index].name);
+        for (const auto stop : objects.buses[index].terminals) {
+            hasher.Add(positions[stop]);
+        }
+        break;
+    case Layer::STOP_POINTS:
+        hasher.Add(positions[index]);
+        break;
+    case Layer::STOP_NAMES:
+        hasher.Add(positions[index]).Add(objects.stops[index].name);
+        break;
+    }
+    return hasher.Get();
+}
 
-    output.AddPtr(std::make_unique<svg::Text>(bottom));
-    output.AddPtr(std::make_unique<svg::Text>(text));
+static bool FragmentKeyLess(const Fragment &lhs, const Fragment &rhs) {
+    return lhs.key < rhs.key;
 }
 
-void Map::InitPaletteColor() {
-    current_color = 0;
+const Fragment* Map::FindFragment(const FragmentKey &key) const {
+    // fragment is reused only if all parts of key are equal
+    auto search = std::lower_bound(fragments_.begin(), fragments_.end(), Fragment { key, nullptr },
+            FragmentKeyLess);
+    if (search != fragments_.end() && search->key == key) {
+        return &*search;
+    }
+    return nullptr;
+}
+
+void Map::UpdateFragments(std::vector<Fragment> fragments) {
+    std::sort(fragments.begin(), fragments.end(), FragmentKeyLess);
+    fragments.erase(std::unique(fragments.begin(), fragments.end(), [](const Fragment &lhs, const Fragment &rhs) {
+        return lhs.key == rhs.key;
+    }), fragments.end());
+
+    // fragments of objects missed in the map are kept for objects coming back in next maps
+    std::vector<Fragment> merged;
+    merged.reserve(fragments.size() + fragments_.size());
+    std::set_union(fragments.begin(), fragments.end(), fragments_.begin(), fragments_.end(),
+            std::back_inserter(merged), FragmentKeyLess);
+    fragments_ = merged.size() > 2 * fragments.size() ? std::move(fragments) : std::move(merged);
+
+    // fragment keeps text of all objects rendered together, texts are copied into one
+    // when less than half of them is used
+    size_t used = 0;
+    size_t kept = 0;
+    std::unordered_set<const std::string*> texts;
+    for (const auto &fragment : fragments_) {
+        used += fragment.size;
+        if (texts.insert(fragment.text.get()).second) {
+            kept += fragment.text->size();
+        }
+    }
+    if (kept > 2 * used) {
+        auto text = std::make_shared<std::string>();
+        text->reserve(used);
+        for (auto &fragment : fragments_) {
+            const size_t offset = text->size();
+            text->append(fragment.GetText());
+            fragment.offset = offset;
+        }
+        for (auto &fragment : fragments_) {
+            fragment.text = text;
+        }
+    }
 }
 
 }
@@ -1,12 +1,19 @@
 #pragma once
 
 #include "geo.h"
+#include "spatial_index.h"
 #include "svg.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
 #include <vector>
 
 namespace tc {
@@ -23,7 +30,7 @@ public:
     template<typename PointInputIt>
     SphereProjector(PointInputIt points_begin, PointInputIt points_end, double max_width, double max_height,
             double padding) :
-            padding_(padding) //
+            offset_(padding, padding) //
     {
         // Если точки поверхности сферы не заданы, вычислять нечего
         if (points_begin == points_end) {
@@ -72,13 +79,22 @@ public:
     // Проецирует широту и долготу в координаты внутри SVG-изображения
     svg::Point operator()(geo::Coordinates coords) const {
         return {
-            (coords.lng - min_lon_) * zoom_coeff_ + padding_,
-            (max_lat_ - coords.lat) * zoom_coeff_ + padding_
+            (coords.lng - min_lon_) * zoom_coeff_ + offset_.x,
+            (max_lat_ - coords.lat) * zoom_coeff_ + offset_.y
         };
     }
 
+    // Проекторы равны, если одинаково проецируют любую точку
+    bool operator==(const SphereProjector &other) const {
+        return offset_.x == other.offset_.x && offset_.y == other.offset_.y && min_lon_ == other.min_lon_
+                && max_lat_ == other.max_lat_ && zoom_coeff_ == other.zoom_coeff_;
+    }
+    bool operator!=(const SphereProjector &other) const {
+        return !(*this == other);
+    }
+
 private:
-    double padding_ = 0;
+    svg::Point offset_;
     double min_lon_ = 0;
     double max_lat_ = 0;
     double zoom_coeff_ = 0;
@@ -97,6 +113,89 @@ struct Settings {
     svg::Color underlayer_color;
     double underlayer_width = 0;
     std::vector<svg::Color> color_palette;
+    // significant digits of numbers in svg output
+    int precision = svg::Writer::DEFAULT_PRECISION;
+    // level of detail: polyline points closer than tolerance pixels to simplified line are skipped,
+    // 0 - polylines are not simplified
+    double simplify_tolerance = 0;
+    // compact svg output: styles as css classes, lines as relative paths,
+    // label underlayer is the stroke of label painted under its fill
+    bool compact = false;
+    // digits after decimal point of coordinates in compact output, 0..svg::PackedDocument::MAX_COMPACT_DECIMALS
+    int compact_decimals = 2;
+};
+
+// Viewport - XYZ tile of map. Zoom 0 is the whole map, every next zoom level splits tile into 2x2 tiles.
+// Tile is rendered with map width and height
+struct Viewport {
+    static constexpr uint32_t MAX_ZOOM = 20;
+
+    uint32_t zoom = 0;
+    uint32_t x = 0;
+    uint32_t y = 0;
+
+    bool IsWholeMap() const {
+        return zoom == 0;
+    }
+    bool IsValid() const {
+        return zoom <= MAX_ZOOM && x < (uint32_t(1) << zoom) && y < (uint32_t(1) << zoom);
+    }
+    // tile size is map size divided by scale
+    double GetScale() const {
+        return static_cast<double>(uint32_t(1) << zoom);
+    }
+    bool operator==(const Viewport &other) const {
+        return zoom == other.zoom && x == other.x && y == other.y;
+    }
+};
+
+// MapLayout - map objects in rendering order
+struct MapLayout {
+    struct BusLine {
+        std::string_view name;
+        std::vector<uint32_t> route; // indexes of polyline stops
+        std::vector<uint32_t> terminals; // indexes of stops with bus labels
+    };
+    struct Stop {
+        std::string_view name;
+        geo::Coordinates position;
+    };
+
+    std::vector<BusLine> buses; // sorted by name, index of bus selects palette color
+    std::vector<Stop> stops; // stops used by buses sorted by name
+};
+
+// FragmentKey - identity of rendered map object: hash of object content and palette color.
+// Independent check hash and number of hashed values verify that fragment with equal hash
+// was rendered from the same object
+struct FragmentKey {
+    uint64_t hash = 0;
+    uint64_t check = 0;
+    uint64_t length = 0;
+
+    bool operator==(const FragmentKey &other) const {
+        return hash == other.hash && check == other.check && length == other.length;
+    }
+    bool operator<(const FragmentKey &other) const {
+        return std::tie(hash, check, length) < std::tie(other.hash, other.check, other.length);
+    }
+};
+
+// Fragment - rendered text of map object, part of text shared by objects rendered together
+struct Fragment {
+    FragmentKey key;
+    std::shared_ptr<const std::string> text;
+    size_t offset = 0;
+    size_t size = 0;
+
+    std::string_view GetText() const {
+        return std::string_view(*text).substr(offset, size);
+    }
+};
+
+// layers of map objects in z-order
+enum class Layer {
+    BUS_LINES, BUS_NAMES, STOP_POINTS, STOP_NAMES
 };
 
 /// renderer::Map - renderer for Bus lines Map
@@ -104,20 +203,139 @@ class Map {
 public:
     void SetSettings(const Settings &settings) {
         settings_ = settings;
+        settings_loader_ = nullptr;
+        ResetCachedMap();
     }
+    // settings will be loaded by loader on first map rendering (InitProjector or SetLayout call)
+    void SetSettingsLoader(std::function<Settings()> loader) {
+        settings_loader_ = std::move(loader);
+        ResetCachedMap();
+    }
+
+    // returns rendered map if it was rendered for the same data version with current settings, otherwise nullptr.
+    // Map text is kept in the form it is written to output, so it is shared with answers instead of copied
+    std::shared_ptr<const std::string> GetCachedMap(uint64_t data_version) const;
+    // remember rendered map for data version
+    void SetCachedMap(uint64_t data_version, std::shared_ptr<const std::string> map);
+    // reset rendered map, fragments and layout
+    void ResetCachedMap();
     void InitProjector(const std::vector<geo::Coordinates> &points);
-    void RenderLine(const std::vector<geo::Coordinates> &points, svg::Document &output);
-    void RenderBusName(const geo::Coordinates &point, const std::string_view &bus_name, svg::Document &output);
-    void RenderBusStopPoint(const geo::Coordinates &point, svg::Document &output);
-    void RenderBusStopName(const geo::Coordinates &point, const std::string_view &bus_stop_name, svg::Document &output);
-    void InitPaletteColor();
-    void SetNextColor();
-    svg::Color GetGolorFromPalette();
+    // add map styles of current settings to document, must be called after InitProjector or SetLayout
+    void InitDocument(svg::PackedDocument &output);
+    // true if layout was set for data version with current settings
+    bool HasLayout(uint64_t data_version) const;
+    // set map objects of data version: init projector by stops, project every stop once,
+    // build spatial indexes and simplify polylines. Names must be valid while layout is used
+    void SetLayout(uint64_t data_version, MapLayout objects);
+
+    size_t GetBusesCount() const {
+        return layout_->objects.buses.size();
+    }
+    size_t GetBusStopsCount() const {
+        return layout_->objects.stops.size();
+    }
+    // number of objects of layer in layout
+    size_t GetObjectsCount(Layer layer) const;
+
+    // render methods of whole map objects don't change renderer and may be called concurrently
+    // for documents with styles of InitDocument. Objects are selected by index in layout,
+    // index of bus selects palette color
+    void RenderLine(size_t bus, svg::PackedDocument &output) const;
+    void RenderBusName(size_t bus, svg::PackedDocument &output) const;
+    void RenderBusStopPoint(size_t stop, svg::PackedDocument &output) const;
+    void RenderBusStopName(size_t stop, svg::PackedDocument &output) const;
+    // render object of layer by its render method
+    void RenderObject(Layer layer, size_t index, svg::PackedDocument &output) const;
+    // reserve document memory for objects [first, last) of layer
+    void ReserveObjects(Layer layer, size_t first, size_t last, svg::PackedDocument &output) const;
+
+    // key of object content and palette color. Objects with equal keys have equal rendered fragments
+    // while projector and settings are not changed
+    FragmentKey GetFragmentKey(Layer layer, size_t index) const;
+    // rendered fragment by key, nullptr if there is no such fragment
+    const Fragment* FindFragment(const FragmentKey &key) const;
+    size_t GetFragmentsCount() const {
+        return fragments_.size();
+    }
+    // keep fragments of all objects of rendered map. Fragments of previous maps are kept
+    // while cache is at most twice as large as the map
+    void UpdateFragments(std::vector<Fragment> fragments);
+
+    // render only objects of layout visible in viewport, must be called after InitDocument
+    void RenderViewport(const Viewport &viewport, svg::PackedDocument &output) const;
+
+    // significant digits of numbers in svg output
+    int GetPrecision() const {
+        return settings_.precision;
+    }
 
 private:
+    // document styles of map objects
+    struct Styles {
+        std::vector<svg::PackedDocument::StyleId> lines; // by palette color
+        std::vector<svg::PackedDocument::StyleId> bus_labels; // by palette color
+        svg::PackedDocument::StyleId bus_label_underlayer = 0;
+        svg::PackedDocument::StyleId stop_point = 0;
+        svg::PackedDocument::StyleId stop_label = 0;
+        svg::PackedDocument::StyleId stop_label_underlayer = 0;
+    };
+
+    // map objects with spatial indexes over positions on whole map
+    struct IndexedLayout {
+        uint64_t version = 0;
+        MapLayout objects;
+        std::vector<svg::Point> positions; // projected stops on whole map by stop index
+        std::vector<uint32_t> first_segment; // first polyline segment id of every bus, buses + 1 items
+        std::vector<std::pair<uint32_t, uint32_t>> bus_labels; // bus index and stop index of label
+        GridIndex segments;
+        GridIndex labels; // bus labels by position
+        GridIndex stops;
+        double margin = 0; // maximal distance from stop or line to border of its image, pixels
+        // per bus route point: distance of point from simplified line on whole map, pixels.
+        // Point is rendered at zoom if distance * scale exceeds tolerance. Empty if lines are not simplified
+        std::vector<std::vector<float>> significance;
+    };
+
+    // load deferred settings if loader was set
+    void EnsureSettings();
+    // set underlayer attributes of label
+    void SetUnderlayer(svg::Text &text) const;
+    // estimated bounds of label text at position
+    Rect GetLabelBox(svg::Point position, svg::Point offset, int font_size, size_t length) const;
+    // transformation of whole map position into viewport position
+    struct ViewportTransform {
+        double scale = 1;
+        svg::Point origin;
+
+        svg::Point operator()(svg::Point position) const {
+            return {position.x * scale - origin.x, position.y * scale - origin.y};
+        }
+    };
+
+    // bounds of polyline segment, segment of one point route is the point
+    static Rect GetSegmentBox(const std::vector<svg::Point> &positions, const std::vector<uint32_t> &route,
+            size_t segment);
+    // Douglas-Peucker significance of route points on whole map
+    static std::vector<float> SimplifyRoute(const std::vector<svg::Point> &positions,
+            const std::vector<uint32_t> &route);
+
+    // add polyline of bus route points [first, last], inner points are skipped if they are insignificant at scale
+    void AddLine(const ViewportTransform &transform, size_t bus, size_t first, size_t last,
+            svg::PackedDocument &output) const;
+    void AddBusName(svg::Point point, size_t bus, svg::PackedDocument &output) const;
+    void AddBusStopName(svg::Point point, size_t stop, svg::PackedDocument &output) const;
+
     Settings settings_;
+    std::function<Settings()> settings_loader_;
+
+    // rendered map cache
+    std::shared_ptr<const std::string> cached_map_;
+    uint64_t cached_map_version_ = 0;
     SphereProjector projector_;
-    size_t current_color = 0;
+    Styles styles_;
+    std::optional<IndexedLayout> layout_;
+    // rendered map objects sorted by key, valid for current projector and settings
+    std::vector<Fragment> fragments_;
 };
 
 } // namespace reder
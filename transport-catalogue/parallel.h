@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace tc {
+
+namespace detail {
+
+// [begin, end) range of elements indexes
+using IndexRange = std::pair<size_t, size_t>;
+
+// default number of worker threads - number of hardware cores
+inline size_t DefaultThreadsNumber() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// split [0, size) into at most chunks consecutive ranges, every range has at least min_chunk elements
+inline std::vector<IndexRange> SplitRange(size_t size, size_t chunks, size_t min_chunk = 1) {
+    chunks = std::max<size_t>(1, std::min(chunks, size / std::max<size_t>(1, min_chunk)));
+    std::vector<IndexRange> result;
+    result.reserve(chunks);
+    size_t begin = 0;
+    for (size_t i = 0; i < chunks; ++i) {
+        size_t end = begin + (size - begin) / (chunks - i);
+        result.emplace_back(begin, end);
+        begin = end;
+    }
+    return result;
+}
+
+// ThreadPool - fixed number of worker threads executing submitted tasks in FIFO order
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    // waits for all submitted tasks
+    ~ThreadPool();
+
+    size_t Size() const {
+        return workers_.size();
+    }
+
+    // schedule func() execution, returns future for its result
+    template<typename Func>
+    auto Submit(Func func) {
+        using Result = std::invoke_result_t<Func&>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(func));
+        auto future = task->get_future();
+        {
+            std::lock_guard lock(mutex_);
+            tasks_.emplace_back([task]() {
+                (*task)();
+            });
+        }
+        has_tasks_.notify_one();
+        return future;
+    }
+
+private:
+    void WorkerLoop();
+
+    std::mutex mutex_;
+    std::condition_variable has_tasks_;
+    std::deque<std::function<void()>> tasks_;
+    bool stop_ = false;
+    std::vector<std::thread> workers_;
+};
+
+// SpscQueue - bounded lock-free queue for one producer thread and one consumer thread.
+// Push waits while queue is full (backpressure), Pop waits while queue is empty.
+// Waiting thread spins shortly and then sleeps, so idle stage doesn't take a core
+template<typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) :
+            slots_(capacity + 1) {
+    }
+
+    void Push(T value) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t next = Next(tail);
+        Wait([this, next]() {
+            return next != head_.load(std::memory_order_acquire);
+        });
+        slots_[tail] = std::move(value);
+        tail_.store(next, std::memory_order_release);
+        Notify();
+    }
+
+    T Pop() {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        Wait([this, head]() {
+            return head != tail_.load(std::memory_order_acquire);
+        });
+        T value = std::move(slots_[head]);
+        head_.store(Next(head), std::memory_order_release);
+        Notify();
+        return value;
+    }
+
+private:
+    // yields before thread sleeps on condition variable
+    static constexpr int SPIN_LIMIT = 64;
+
+    size_t Next(size_t index) const {
+        return index + 1 == slots_.size() ? 0 : index + 1;
+    }
+
+    template<typename Ready>
+    void Wait(Ready ready) {
+        for (int i = 0; i < SPIN_LIMIT; ++i) {
+            if (ready()) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+        std::unique_lock lock(mutex_);
+        waiters_.fetch_add(1, std::memory_order_relaxed);
+        // pairs with fence of Notify: either waiter sees new position or notifier sees waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        changed_.wait(lock, ready);
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // wake sleeping thread, no locking if nobody sleeps
+    void Notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters_.load(std::memory_order_relaxed) != 0) {
+            // waiter checks position and falls asleep under mutex, so notification is not lost
+            {
+                std::lock_guard lock(mutex_);
+            }
+            changed_.notify_all();
+        }
+    }
+
+    std::vector<T> slots_;
+    // consumer and producer positions are placed in different cache lines
+    alignas(64) std::atomic<size_t> head_ { 0 };
+    alignas(64) std::atomic<size_t> tail_ { 0 };
+    alignas(64) std::atomic<int> waiters_ { 0 };
+    std::mutex mutex_;
+    std::condition_variable changed_;
+};
+
+// call func(begin, end) for every range, ranges except first one are processed by pool threads.
+// without pool all ranges are processed in caller thread, no threads are created.
+// Must not be called from pool thread of the same pool.
+// returns results in ranges order
+template<typename Func>
+auto ParallelMap(const std::vector<IndexRange> &ranges, Func func, ThreadPool *pool) {
+    using Result = std::invoke_result_t<Func&, size_t, size_t>;
+    std::vector<Result> results;
+    results.reserve(ranges.size());
+    if (ranges.empty()) {
+        return results;
+    }
+    if (pool == nullptr) {
+        for (const auto &range : ranges) {
+            results.push_back(func(range.first, range.second));
+        }
+        return results;
+    }
+
+    std::vector<std::future<Result>> futures;
+    futures.reserve(ranges.size() - 1);
+    for (auto it = ranges.begin() + 1; it != ranges.end(); ++it) {
+        auto task = [&func, range = *it]() {
+            return func(range.first, range.second);
+        };
+        futures.push_back(pool->Submit(std::move(task)));
+    }
+    // current thread processes the first range
+    try {
+        results.push_back(func(ranges.front().first, ranges.front().second));
+    } catch (...) {
+        // tasks refer to func, wait for them before leave
+        for (auto &future : futures) {
+            future.wait();
+        }
+        throw;
+    }
+    for (auto &future : futures) {
+        future.wait();
+    }
+    for (auto &future : futures) {
+        results.push_back(future.get());
+    }
+    return results;
+}
+
+} // namespace detail
+
+} // namespace tc
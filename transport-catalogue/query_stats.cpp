@@ -0,0 +1,169 @@
+/*
+ * query_stats.cpp
+ *
+ *  Low overhead latency statistics of stat requests
+ */
+
+#include "query_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <unordered_map>
+
+namespace tc {
+
+namespace handler {
+
+LatencyHistogram::LatencyHistogram() :
+        buckets_(BUCKETS, 0) {
+}
+
+size_t LatencyHistogram::BucketIndex(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    if (msb >= MAX_VALUE_BITS) {
+        return BUCKETS - 1;
+    }
+    // SUB_BUCKET_BITS bits after the leading one select bucket inside power of two range
+    uint64_t sub_bucket = (value >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return SUB_BUCKETS + (msb - SUB_BUCKET_BITS) * SUB_BUCKETS + sub_bucket;
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    size_t range = (index - SUB_BUCKETS) / SUB_BUCKETS;
+    uint64_t sub_bucket = (index - SUB_BUCKETS) % SUB_BUCKETS;
+    int msb = range + SUB_BUCKET_BITS;
+    uint64_t step = uint64_t(1) << (msb - SUB_BUCKET_BITS);
+    return (uint64_t(1) << msb) + sub_bucket * step + step - 1;
+}
+
+void LatencyHistogram::Record(uint64_t value) {
+    ++buckets_[BucketIndex(value)];
+    ++count_;
+    max_ = std::max(max_, value);
+}
+
+void LatencyHistogram::AddBucketCount(size_t index, uint64_t count) {
+    buckets_[index] += count;
+    count_ += count;
+}
+
+void LatencyHistogram::UpdateMax(uint64_t value) {
+    max_ = std::max(max_, value);
+}
+
+uint64_t LatencyHistogram::GetPercentile(double fraction) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * count_)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += buckets_[i];
+        if (seen >= target) {
+            return std::min(BucketUpperBound(i), max_);
+        }
+    }
+    return max_;
+}
+
+// source of QueryStats ids
+static std::atomic<uint64_t> last_stats_id { 0 };
+
+QueryStats::Slot::Slot(size_t types) :
+        buckets(types * LatencyHistogram::BUCKETS), max(types) {
+}
+
+class QueryStats::SlotLease {
+public:
+    SlotLease(std::weak_ptr<Slots> slots, Slot &slot) :
+            slots_(std::move(slots)), slot_(slot) {
+    }
+    SlotLease(const SlotLease&) = delete;
+    SlotLease& operator=(const SlotLease&) = delete;
+
+    // counters of slot are kept, they are merged with counters of the next owner
+    ~SlotLease() {
+        if (auto slots = slots_.lock()) {
+            std::lock_guard lock(slots->mutex);
+            slots->free.push_back(&slot_);
+        }
+    }
+
+    Slot& Get() const {
+        return slot_;
+    }
+
+    // QueryStats object is destroyed
+    bool IsExpired() const {
+        return slots_.expired();
+    }
+
+private:
+    std::weak_ptr<Slots> slots_;
+    Slot &slot_;
+};
+
+QueryStats::QueryStats(size_t types) :
+        id_(++last_stats_id), types_(types), slots_(std::make_shared<Slots>()) {
+}
+
+QueryStats::Slot& QueryStats::GetThreadSlot() {
+    // slots of current thread by QueryStats id, ids are never reused
+    thread_local std::unordered_map<uint64_t, SlotLease> thread_slots;
+
+    if (auto search = thread_slots.find(id_); search != thread_slots.end()) {
+        return search->second.Get();
+    }
+    // leases of destroyed objects are dropped when thread takes new slot
+    for (auto it = thread_slots.begin(); it != thread_slots.end();) {
+        it = it->second.IsExpired() ? thread_slots.erase(it) : std::next(it);
+    }
+
+    Slot *slot = nullptr;
+    {
+        std::lock_guard lock(slots_->mutex);
+        if (slots_->free.empty()) {
+            slots_->all.push_back(std::make_unique<Slot>(types_));
+            slot = slots_->all.back().get();
+        } else {
+            // previous owner released slot under the same mutex, its counters are visible
+            slot = slots_->free.back();
+            slots_->free.pop_back();
+        }
+    }
+    return thread_slots.try_emplace(id_, slots_, *slot).first->second.Get();
+}
+
+void QueryStats::Record(size_t type, uint64_t latency_ns) {
+    auto &slot = GetThreadSlot();
+    // the only writer is current thread, relaxed increments are enough
+    auto &bucket = slot.buckets[type * LatencyHistogram::BUCKETS + LatencyHistogram::BucketIndex(latency_ns)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (latency_ns > slot.max[type].load(std::memory_order_relaxed)) {
+        slot.max[type].store(latency_ns, std::memory_order_relaxed);
+    }
+}
+
+LatencyHistogram QueryStats::GetHistogram(size_t type) const {
+    LatencyHistogram result;
+    std::lock_guard lock(slots_->mutex);
+    for (const auto &slot : slots_->all) {
+        const auto *buckets = &slot->buckets[type * LatencyHistogram::BUCKETS];
+        for (size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+            result.AddBucketCount(i, buckets[i].load(std::memory_order_relaxed));
+        }
+        result.UpdateMax(slot->max[type].load(std::memory_order_relaxed));
+    }
+    return result;
+}
+
+} // namespace handler
+
+} // namespace tc
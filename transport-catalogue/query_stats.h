@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace tc {
+
+namespace handler {
+
+/*
+ *  LatencyHistogram - HDR-style log-linear histogram of latencies in nanoseconds.
+ *  Values below 32 have own buckets, every power of two range above is split into 32 buckets,
+ *  so relative error of percentile is below 1/32. Values above 2^40 ns are counted in the last bucket.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 5;
+    static constexpr uint64_t SUB_BUCKETS = uint64_t(1) << SUB_BUCKET_BITS;
+    static constexpr int MAX_VALUE_BITS = 40;
+    static constexpr size_t BUCKETS = SUB_BUCKETS + (MAX_VALUE_BITS - SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+    LatencyHistogram();
+
+    void Record(uint64_t value);
+    // add count values to bucket, used to merge raw counters
+    void AddBucketCount(size_t index, uint64_t count);
+    void UpdateMax(uint64_t value);
+
+    uint64_t GetCount() const {
+        return count_;
+    }
+    uint64_t GetMax() const {
+        return max_;
+    }
+    // value below which fraction (0..1] of recorded values fall, bucket upper bound
+    uint64_t GetPercentile(double fraction) const;
+
+    static size_t BucketIndex(uint64_t value);
+    static uint64_t BucketUpperBound(size_t index);
+
+private:
+    std::vector<uint64_t> buckets_;
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+};
+
+/*
+ *  QueryStats - per query type latency histograms.
+ *  Every thread records into its own thread-local slot without locks,
+ *  slots are merged on read. Slot of finished thread is reused by the next new thread,
+ *  so number of slots does not exceed number of threads recording at once.
+ */
+class QueryStats {
+public:
+    explicit QueryStats(size_t types);
+    QueryStats(const QueryStats&) = delete;
+    QueryStats& operator=(const QueryStats&) = delete;
+
+    void Record(size_t type, uint64_t latency_ns);
+    // merged histogram of all threads
+    LatencyHistogram GetHistogram(size_t type) const;
+
+private:
+    // counters of one thread, written by owner thread only
+    struct Slot {
+        explicit Slot(size_t types);
+
+        std::vector<std::atomic<uint64_t>> buckets; // types * BUCKETS
+        std::vector<std::atomic<uint64_t>> max; // per type
+    };
+
+    // slots of all threads, shared with thread-local leases of slots
+    struct Slots {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Slot>> all;
+        // slots of finished threads
+        std::vector<Slot*> free;
+    };
+
+    // slot owned by thread, returned to free slots on thread exit
+    class SlotLease;
+
+    Slot& GetThreadSlot();
+
+    // identifies object in thread-local slots cache
+    const uint64_t id_;
+    const size_t types_;
+    const std::shared_ptr<Slots> slots_;
+};
+
+} // namespace handler
+
+} // namespace tc
@@ -6,106 +6,503 @@
  */
 
 #include "request_handler.h"
-#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <limits>
+#include <unordered_map>
 
 using namespace std::literals;
 
 namespace tc {
 
 namespace handler {
+
+// minimal number of queries processed by one task
+const size_t MIN_QUERIES_CHUNK = 64;
+// number of tasks per thread for load balancing
+const size_t CHUNKS_PER_THREAD = 4;
+// minimal number of buses or stops rendered by one task
+const size_t MIN_RENDER_CHUNK = 64;
+
+RequestHandler::RequestHandler(size_t threads) :
+        threads_(std::max<size_t>(1, threads)) {
+    if (threads_ > 1) {
+        // caller thread is a worker too
+        pool_ = std::make_unique<detail::ThreadPool>(threads_ - 1);
+        // map is rendered from query task running in pool_ thread, so it needs own pool
+        render_pool_ = std::make_unique<detail::ThreadPool>(threads_ - 1);
+    }
+}
+
 json::Document RequestHandler::HandleQueries(const tc::TransportCatalogue &catalog,
         const json::Document &queries_document, tc::renderer::Map &renderer) const {
 
-    auto queries = queries_document.GetRoot().AsDict().at("stat_requests"s).AsArray();
+    return HandleQueries(catalog, queries_document.GetRoot().AsDict().at("stat_requests"s).AsArray(), renderer);
+}
+
+json::Document RequestHandler::HandleQueries(const tc::TransportCatalogue &catalog,
+        const json::LazyDocument &queries_document, tc::renderer::Map &renderer) const {
 
-    json::Builder builder;
-    builder.StartArray();
+    return HandleQueries(catalog, queries_document.GetSection("stat_requests"s).AsArray(), renderer);
+}
 
-    json::Array results;
+json::Document RequestHandler::HandleQueries(const tc::TransportCatalogue &catalog, const json::Array &queries,
+        tc::renderer::Map &renderer) const {
+
+    return HandleQueries(catalog, CompileQueries(queries), renderer);
+}
+
+QueryPlan RequestHandler::CompileQueries(const json::Array &queries) const {
+    QueryPlan plan;
+    plan.reserve(queries.size());
 
-    for (const auto &query : queries) {
-        if (query.AsDict().at("type"s) == "Bus"s) {
-            HandleBusQuery(catalog, query, builder);
-        } else if (query.AsDict().at("type"s) == "Stop"s) {
-            HandleBusStopQuery(catalog, query, builder);
-        } else if (query.AsDict().at("type"s) == "Map"s) {
-            HandleMapQuery(catalog, query, renderer, builder);
+    for (const auto &node : queries) {
+        if (auto compiled = CompileQuery(node.AsDict())) {
+            plan.push_back(*compiled);
         }
+    }
+    return plan;
+}
 
+std::optional<StatQuery> RequestHandler::CompileQuery(const json::Dict &query) {
+    const auto &type = query.at("type"s);
+    StatQuery compiled;
+    if (type == "Bus"s) {
+        compiled.type = QueryType::BUS;
+    } else if (type == "Stop"s) {
+        compiled.type = QueryType::STOP;
+    } else if (type == "Map"s) {
+        compiled.type = QueryType::MAP;
+    } else if (type == "Stats"s) {
+        compiled.type = QueryType::STATS;
+    } else {
+        return std::nullopt; // unknown query type has no answer
+    }
+    compiled.id = query.at("id"s).AsInt();
+    if (compiled.type == QueryType::BUS || compiled.type == QueryType::STOP) {
+        compiled.name = query.at("name"s).AsString();
     }
-    builder.EndArray();
+    if (compiled.type == QueryType::MAP) {
+        compiled.viewport = CompileViewport(query);
+    }
+    return compiled;
+}
 
-    return json::Document(builder.Build());
+tc::renderer::Viewport RequestHandler::CompileViewport(const json::Dict &query) {
+    const auto zoom = query.find("zoom"s);
+    const auto x = query.find("x"s);
+    const auto y = query.find("y"s);
+    tc::renderer::Viewport viewport;
+    if (zoom == query.end() && x == query.end() && y == query.end()) {
+        return viewport;
+    }
+    // incomplete tile or not integer numbers are answered as invalid tile
+    viewport.zoom = tc::renderer::Viewport::MAX_ZOOM + 1;
+    if (zoom == query.end() || x == query.end() || y == query.end() || !zoom->second.IsInt()
+            || !x->second.IsInt() || !y->second.IsInt()) {
+        return viewport;
+    }
+    // negative values become invalid tile
+    viewport.zoom = static_cast<uint32_t>(zoom->second.AsInt());
+    viewport.x = static_cast<uint32_t>(x->second.AsInt());
+    viewport.y = static_cast<uint32_t>(y->second.AsInt());
+    return viewport;
+}
+
+// identity of query for deduplication
+struct QueryKey {
+    QueryType type;
+    std::string_view name;
+    tc::renderer::Viewport viewport;
+
+    bool operator==(const QueryKey &other) const {
+        return type == other.type && name == other.name && viewport == other.viewport;
+    }
+};
+
+struct QueryKeyHash {
+    size_t operator()(const QueryKey &key) const {
+        size_t hash = std::hash<std::string_view> { }(key.name) * 37 + static_cast<size_t>(key.type);
+        return ((hash * 37 + key.viewport.zoom) * 37 + key.viewport.x) * 37 + key.viewport.y;
+    }
+};
+
+json::Document RequestHandler::HandleQueries(const tc::TransportCatalogue &catalog, const QueryPlan &plan,
+        tc::renderer::Map &renderer) const {
+
+    // group identical queries by (type, name, viewport), every distinct query is executed once
+    std::vector<size_t> distinct_of_query(plan.size());
+    std::vector<const StatQuery*> distinct_queries;
+    std::vector<size_t> distinct_uses;
+    std::unordered_map<QueryKey, size_t, QueryKeyHash> distinct_index;
+
+    for (size_t i = 0; i < plan.size(); ++i) {
+        const auto &query = plan[i];
+        auto [search, inserted] = distinct_index.emplace(QueryKey { query.type, query.name, query.viewport },
+                distinct_queries.size());
+        if (inserted) {
+            distinct_queries.push_back(&query);
+            distinct_uses.push_back(0);
+        }
+        distinct_of_query[i] = search->second;
+        ++distinct_uses[search->second];
+    }
+
+    // without pool all queries are executed in caller thread by one task
+    const auto ranges = detail::SplitRange(distinct_queries.size(), pool_ ? threads_ * CHUNKS_PER_THREAD : 1,
+            MIN_QUERIES_CHUNK);
+
+    // every task writes answers into its own array
+    auto chunks = detail::ParallelMap(ranges, [&](size_t begin, size_t end) {
+        json::Builder builder;
+        builder.StartArray();
+        for (size_t i = begin; i < end; ++i) {
+            HandleQuery(catalog, *distinct_queries[i], renderer, builder);
+        }
+        builder.EndArray();
+        return builder.Build();
+    }, pool_.get());
+
+    std::vector<json::Node> answers;
+    answers.reserve(distinct_queries.size());
+    for (auto &chunk : chunks) {
+        for (auto &answer : chunk.AsArray()) {
+            answers.push_back(std::move(answer));
+        }
+    }
+
+    // join answers in original request order, the last use of answer takes it without copy
+    json::Array results;
+    results.reserve(plan.size());
+    for (size_t i = 0; i < plan.size(); ++i) {
+        size_t distinct = distinct_of_query[i];
+        if (--distinct_uses[distinct] == 0) {
+            results.push_back(std::move(answers[distinct]));
+        } else {
+            results.push_back(answers[distinct]);
+        }
+        results.back().AsDict()["request_id"s] = plan[i].id;
+    }
+
+    queries_count_ += results.size();
+    executed_count_ += distinct_queries.size();
+
+    return json::Document(std::move(results));
+}
+
+RequestHandler::DedupStats RequestHandler::GetDedupStats() const {
+    return {queries_count_.load(), executed_count_.load()};
+}
+
+void RequestHandler::HandleQuery(const tc::TransportCatalogue &catalog, const StatQuery &query,
+        tc::renderer::Map &renderer, json::Builder &builder) const {
+
+    const auto start = std::chrono::steady_clock::now();
+
+    switch (query.type) {
+    case QueryType::BUS:
+        HandleBusQuery(catalog, query, builder);
+        break;
+    case QueryType::STOP:
+        HandleBusStopQuery(catalog, query, builder);
+        break;
+    case QueryType::MAP: {
+        std::lock_guard lock(renderer_mutex_);
+        HandleMapQuery(catalog, query, renderer, builder);
+        break;
+    }
+    case QueryType::STATS:
+        HandleStatsQuery(catalog, query, builder);
+        break;
+    }
+
+    const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start);
+    query_stats_.Record(static_cast<size_t>(query.type), latency.count());
+}
+
+LatencyHistogram RequestHandler::GetLatencyHistogram(QueryType type) const {
+    return query_stats_.GetHistogram(static_cast<size_t>(type));
+}
+
+void RequestHandler::HandleStatsQuery(const tc::TransportCatalogue &catalog, const StatQuery &query,
+        json::Builder &builder) const {
+
+    // latencies are printed in microseconds
+    auto to_us = [](uint64_t ns) {
+        return ns / 1000.0;
+    };
+    // counters of long running server are clamped instead of wrapping over int range
+    auto counter = [](uint64_t value) {
+        return static_cast<int>(std::min<uint64_t>(value, std::numeric_limits<int>::max()));
+    };
+    auto hit_rate = [](size_t hits, size_t total) {
+        return total ? static_cast<double>(hits) / total : 0.0;
+    };
+
+    builder.StartDict().Key("request_id"s).Value(query.id);
+
+    builder.Key("queries"s).StartDict();
+    const std::pair<QueryType, std::string> types[] = { { QueryType::BUS, "Bus"s }, { QueryType::STOP, "Stop"s }, {
+            QueryType::MAP, "Map"s }, { QueryType::STATS, "Stats"s } };
+    for (const auto& [type, name] : types) {
+        auto histogram = GetLatencyHistogram(type);
+        builder.Key(name).StartDict();
+        builder.Key("count"s).Value(counter(histogram.GetCount()));
+        builder.Key("p50_us"s).Value(to_us(histogram.GetPercentile(0.5)));
+        builder.Key("p90_us"s).Value(to_us(histogram.GetPercentile(0.9)));
+        builder.Key("p99_us"s).Value(to_us(histogram.GetPercentile(0.99)));
+        builder.Key("max_us"s).Value(to_us(histogram.GetMax()));
+        builder.EndDict();
+    }
+    builder.EndDict();
+
+    size_t hits = map_cache_hits_.load();
+    size_t misses = map_cache_misses_.load();
+    builder.Key("map_cache"s).StartDict();
+    builder.Key("hits"s).Value(counter(hits));
+    builder.Key("misses"s).Value(counter(misses));
+    builder.Key("hit_rate"s).Value(hit_rate(hits, hits + misses));
+    builder.Key("fragments_reused"s).Value(counter(fragments_reused_.load()));
+    builder.Key("fragments_rendered"s).Value(counter(fragments_rendered_.load()));
+    builder.EndDict();
+
+    auto dedup = GetDedupStats();
+    builder.Key("dedup"s).StartDict();
+    builder.Key("queries"s).Value(counter(dedup.queries));
+    builder.Key("executed"s).Value(counter(dedup.executed));
+    builder.Key("saved"s).Value(counter(dedup.Saved()));
+    builder.Key("hit_rate"s).Value(hit_rate(dedup.Saved(), dedup.queries));
+    builder.EndDict();
+
+    builder.Key("catalogue"s).StartDict();
+    builder.Key("buses"s).Value(counter(catalog.GetBusesCount()));
+    builder.Key("stops"s).Value(counter(catalog.GetBusStopsCount()));
+    builder.Key("memory_kb"s).Value(counter(catalog.GetMemoryUsage() / 1024));
+    builder.EndDict();
+
+    builder.EndDict();
 }
 
 void RequestHandler::RenderBusRoutesMap(const tc::TransportCatalogue &catalog, tc::renderer::Map &renderer,
         std::ostream &out) const {
-    svg::Document bus_map;
-
-    // init renderer by all stops points
-    auto points = catalog.GetAllBusStopsCoordinates();
-    // initialize renderer
-    renderer.InitProjector(points);
-    renderer.InitPaletteColor();
-
-    // render bus lines
-    auto buses = catalog.GetSortedBusNames();
-    // render buses in sorted by name order
-    for (const auto bus_name : buses) {
-        auto points = catalog.GetBusStopsCoordinates(bus_name);
-        if (points.size()) {
-            renderer.RenderLine(points, bus_map);
+    // styles document is copied into document of every chunk
+    EnsureMapLayout(catalog, renderer);
+    svg::PackedDocument styles;
+    renderer.InitDocument(styles);
+
+    // layers in z-order, every layer is split into chunks
+    using tc::renderer::Layer;
+    std::vector<MapChunk> chunks;
+    size_t objects_count = 0;
+    // buses are rendered in sorted by name order, palette color is selected by bus index
+    for (auto layer : { Layer::BUS_LINES, Layer::BUS_NAMES, Layer::STOP_POINTS, Layer::STOP_NAMES }) {
+        const size_t size = renderer.GetObjectsCount(layer);
+        objects_count += size;
+        for (auto range : detail::SplitRange(size, threads_ * CHUNKS_PER_THREAD, MIN_RENDER_CHUNK)) {
+            chunks.push_back( { layer, range });
+        }
+    }
+
+    RenderMapFragments(renderer, styles, chunks, objects_count, out);
+}
+
+void RequestHandler::ForEachMapChunk(size_t chunks_count, const std::function<void(size_t)> &render) const {
+    // every thread takes next chunk until all chunks are rendered
+    std::atomic<size_t> next_chunk = 0;
+    detail::ParallelMap(detail::SplitRange(std::min(threads_, chunks_count), threads_), [&](size_t, size_t) {
+        for (size_t i = next_chunk++; i < chunks_count; i = next_chunk++) {
+            render(i);
+        }
+        return 0;
+    }, render_pool_.get());
+}
+
+void RequestHandler::RenderMapFragments(tc::renderer::Map &renderer, const svg::PackedDocument &styles,
+        const std::vector<MapChunk> &chunks, size_t objects_count, std::ostream &out) const {
+
+    // fragments of chunk objects in z-order, objects missed in renderer cache are rendered again
+    struct ChunkFragments {
+        std::vector<tc::renderer::Fragment> fragments;
+        size_t rendered = 0;
+    };
+
+    // missed objects are rendered into document of chunk, renderer is used read only.
+    // fragments of rendered objects refer to one shared text of chunk
+    const auto &map_renderer = renderer;
+    // without cached fragments every object is rendered, chunk documents are reserved for all of them
+    const bool cold = renderer.GetFragmentsCount() == 0;
+    auto render_chunk = [&](const MapChunk &chunk) {
+        ChunkFragments result;
+        result.fragments.reserve(chunk.range.second - chunk.range.first);
+        svg::PackedDocument document = styles;
+        if (cold) {
+            map_renderer.ReserveObjects(chunk.layer, chunk.range.first, chunk.range.second, document);
+        }
+        std::vector<detail::IndexRange> elements; // elements of rendered objects
+        std::vector<size_t> positions; // positions of rendered objects in chunk
+        for (size_t i = chunk.range.first; i < chunk.range.second; ++i) {
+            const auto key = map_renderer.GetFragmentKey(chunk.layer, i);
+            if (const auto *fragment = map_renderer.FindFragment(key)) {
+                result.fragments.push_back(*fragment);
+                continue;
+            }
+            const size_t begin = document.Size();
+            map_renderer.RenderObject(chunk.layer, i, document);
+            elements.emplace_back(begin, document.Size());
+            positions.push_back(result.fragments.size());
+            result.fragments.push_back( { key, nullptr });
         }
-        renderer.SetNextColor();
-    }
-    // initialize renderer palette color to start
-    renderer.InitPaletteColor();
-    // render bus names in sorted by name order
-    for (const auto bus_name : buses) {
-        auto stops_points = catalog.GetBusStopsForName(bus_name);
-        for (const auto &point : stops_points) {
-            renderer.RenderBusName(point, bus_name, bus_map);
+        if (elements.empty()) {
+            return result;
         }
-        renderer.SetNextColor(); // switch palette to next color
+        svg::Writer writer(map_renderer.GetPrecision());
+        for (size_t i = 0; i < elements.size(); ++i) {
+            auto &fragment = result.fragments[positions[i]];
+            fragment.offset = writer.GetBuffer().size();
+            document.RenderElements(writer, elements[i].first, elements[i].second);
+            fragment.size = writer.GetBuffer().size() - fragment.offset;
+        }
+        std::shared_ptr<const std::string> text = std::make_shared<std::string>(writer.Release());
+        for (const auto position : positions) {
+            result.fragments[position].text = text;
+        }
+        result.rendered = elements.size();
+        return result;
+    };
+
+    std::vector<ChunkFragments> parts(chunks.size());
+    ForEachMapChunk(chunks.size(), [&](size_t i) {
+        parts[i] = render_chunk(chunks[i]);
+    });
+
+    // output result document, fragments are joined in z-order
+    std::vector<tc::renderer::Fragment> fragments;
+    fragments.reserve(objects_count);
+    size_t rendered = 0;
+    for (auto &part : parts) {
+        std::move(part.fragments.begin(), part.fragments.end(), std::back_inserter(fragments));
+        rendered += part.rendered;
+    }
+    WriteMapDocument(styles, fragments, renderer.GetPrecision(), out);
+
+    fragments_rendered_ += rendered;
+    fragments_reused_ += objects_count - rendered;
+
+    // fragments of every map are kept, so the first catalog change reuses fragments of the first map
+    renderer.UpdateFragments(std::move(fragments));
+}
+
+void RequestHandler::WriteMapDocument(const svg::PackedDocument &styles,
+        const std::vector<tc::renderer::Fragment> &fragments, int precision, std::ostream &out) {
+    size_t size = 0;
+    for (const auto &fragment : fragments) {
+        size += fragment.size;
     }
-    // render bus_stops circles
-    auto bus_stops = catalog.GetAllBusStopsNamesAndCoordinatesSortedByName();
-    for (const auto& [_, point] : bus_stops) {
-        renderer.RenderBusStopPoint(point, bus_map);
+    svg::Writer writer(precision);
+    writer.Reserve(size + 256);
+    svg::RenderDocumentBegin(writer);
+    styles.RenderStyles(writer);
+    for (const auto &fragment : fragments) {
+        writer << fragment.GetText();
     }
+    svg::RenderDocumentEnd(writer);
+    out.write(writer.GetBuffer().data(), writer.GetBuffer().size());
+}
 
-    // render bus stops names;
-    for (const auto& [name, point] : bus_stops) {
-        renderer.RenderBusStopName(point, name, bus_map);
+tc::renderer::MapLayout RequestHandler::BuildMapLayout(const tc::TransportCatalogue &catalog) {
+    tc::renderer::MapLayout layout;
+    // buses refer to stops by index, so every stop coordinate is taken and projected once
+    std::unordered_map<std::string_view, uint32_t> stop_indexes;
+    for (const auto& [name, position] : catalog.GetAllBusStopsNamesAndCoordinatesSortedByName()) {
+        stop_indexes.emplace(name, static_cast<uint32_t>(layout.stops.size()));
+        layout.stops.push_back( { name, position });
     }
+    // route and terminals rules are owned by catalog
+    auto indexes = [&stop_indexes](const tc::BusStops &stops) {
+        std::vector<uint32_t> result;
+        result.reserve(stops.size());
+        for (const auto stop : stops) {
+            result.push_back(stop_indexes.at(stop->getName()));
+        }
+        return result;
+    };
+    const auto buses = catalog.GetSortedBusNames();
+    layout.buses.reserve(buses.size());
+    for (const auto name : buses) {
+        layout.buses.push_back( { name, indexes(catalog.GetBusRouteStops(name)), indexes(catalog.GetBusTerminals(
+                name)) });
+    }
+    return layout;
+}
 
-    // output result document
-    bus_map.Render(out);
+void RequestHandler::EnsureMapLayout(const tc::TransportCatalogue &catalog, tc::renderer::Map &renderer) {
+    // projector, spatial indexes and simplified lines are the same for all maps of catalog version
+    if (!renderer.HasLayout(catalog.GetVersion())) {
+        renderer.SetLayout(catalog.GetVersion(), BuildMapLayout(catalog));
+    }
 }
 
-void RequestHandler::HandleMapQuery(const tc::TransportCatalogue &catalog, const json::Node &query,
-        tc::renderer::Map &renderer, json::Builder &builder) const {
+void RequestHandler::RenderMapViewport(const tc::TransportCatalogue &catalog,
+        const tc::renderer::Viewport &viewport, tc::renderer::Map &renderer, std::ostream &out) const {
 
-    int id = query.AsDict().at("id"s).AsInt();
+    EnsureMapLayout(catalog, renderer);
+    svg::PackedDocument document;
+    renderer.InitDocument(document);
+    renderer.RenderViewport(viewport, document);
+    document.Render(out, renderer.GetPrecision());
+}
 
-    builder.StartDict().Key("request_id"s).Value(id);
+void RequestHandler::HandleMapQuery(const tc::TransportCatalogue &catalog, const StatQuery &query,
+        tc::renderer::Map &renderer, json::Builder &builder) const {
 
-    std::ostringstream out;
+    builder.StartDict().Key("request_id"s).Value(query.id);
 
-    RenderBusRoutesMap(catalog, renderer, out);
-    builder.Key("map"s).Value(std::move(out).str());
+    if (!query.viewport.IsValid()) {
+        builder.Key("error_message"s).Value("invalid tile"s).EndDict();
+        return;
+    }
+    // svg is escaped while it is rendered and printed into answer as is
+    auto render_escaped = [&](auto render) {
+        auto text = std::make_shared<std::string>();
+        json::EscapingStreambuf buffer(*text);
+        std::ostream out(&buffer);
+        render(out);
+        return text;
+    };
+
+    if (!query.viewport.IsWholeMap()) {
+        auto map = render_escaped([&](std::ostream &out) {
+            RenderMapViewport(catalog, query.viewport, renderer, out);
+        });
+        builder.Key("map"s).Value(json::EscapedString(std::move(map))).EndDict();
+        return;
+    }
+
+    // map is rendered again only if catalog or render settings were changed,
+    // cached map is shared by answers without copying
+    auto map = renderer.GetCachedMap(catalog.GetVersion());
+    if (map != nullptr) {
+        ++map_cache_hits_;
+    } else {
+        ++map_cache_misses_;
+        map = render_escaped([&](std::ostream &out) {
+            RenderBusRoutesMap(catalog, renderer, out);
+        });
+        renderer.SetCachedMap(catalog.GetVersion(), map);
+    }
+    builder.Key("map"s).Value(json::EscapedString(std::move(map)));
 
     builder.EndDict();
 }
 
-void RequestHandler::HandleBusQuery(const tc::TransportCatalogue &catalog, const json::Node &query,
+void RequestHandler::HandleBusQuery(const tc::TransportCatalogue &catalog, const StatQuery &query,
         json::Builder &builder) const {
 
-    int id = query.AsDict().at("id"s).AsInt();
-
-    builder.StartDict().Key("request_id"s).Value(id);
+    builder.StartDict().Key("request_id"s).Value(query.id);
 
-    auto query_result = catalog.ProcessBusQuery(query.AsDict().at("name"s).AsString());
+    auto query_result = catalog.ProcessBusQuery(query.name);
 
     if (query_result.valid) { // bus was found
         builder.Key("curvature"s).Value(query_result.curvature);
@@ -119,13 +516,12 @@ void RequestHandler::HandleBusQuery(const tc::TransportCatalogue &catalog, const
     builder.EndDict();
 }
 
-void RequestHandler::HandleBusStopQuery(const tc::TransportCatalogue &catalog, const json::Node &query,
+void RequestHandler::HandleBusStopQuery(const tc::TransportCatalogue &catalog, const StatQuery &query,
         json::Builder &builder) const {
 
-    int id = query.AsDict().at("id"s).AsInt();
-    builder.StartDict().Key("request_id"s).Value(id);
+    builder.StartDict().Key("request_id"s).Value(query.id);
 
-    auto query_result = catalog.ProcessBusStopQuery(query.AsDict().at("name"s).AsString());
+    auto query_result = catalog.ProcessBusStopQuery(query.name);
 
     if (query_result.valid) { // bus stop found
 
@@ -1,31 +1,155 @@
 #pragma once
 
+#include <atomic>
 #include <exception>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
 #include "json.h"
 #include "transport_catalogue.h"
 #include "map_renderer.h"
 #include "json_builder.h"
+#include "parallel.h"
+#include "query_stats.h"
 
 namespace tc {
 
 namespace handler {
 
+enum class QueryType {
+    BUS, STOP, MAP, STATS
+};
+
+// number of QueryType values
+inline const size_t QUERY_TYPES_COUNT = 4;
+
+// compiled stat request
+struct StatQuery {
+    QueryType type = QueryType::MAP;
+    int id = 0;
+    // bus or bus stop name, refers to string in requests array
+    std::string_view name;
+    // map tile, whole map by default
+    tc::renderer::Viewport viewport;
+};
+
+using QueryPlan = std::vector<StatQuery>;
+
 class RequestHandler {
 public:
+    // batch deduplication counters
+    struct DedupStats {
+        size_t queries = 0; // answered queries
+        size_t executed = 0; // distinct queries really executed
+
+        // number of queries answered by reuse of other query result
+        size_t Saved() const {
+            return queries - executed;
+        }
+    };
+
+    // threads - number of threads for queries execution, 1 - sequential execution in caller thread.
+    // queries are split by chunks between threads, results are joined in original request order
+    explicit RequestHandler(size_t threads = 1);
+
     json::Document HandleQueries(const tc::TransportCatalogue &catalog, const json::Document &queries_document,
             tc::renderer::Map &renderer) const;
 
-    void HandleBusQuery(const tc::TransportCatalogue &catalog, const json::Node &query, json::Builder &builder) const;
+    // handle "stat_requests" section of lazy loaded document
+    json::Document HandleQueries(const tc::TransportCatalogue &catalog, const json::LazyDocument &queries_document,
+            tc::renderer::Map &renderer) const;
+
+    // handle array of stat requests, requests are compiled to QueryPlan first
+    json::Document HandleQueries(const tc::TransportCatalogue &catalog, const json::Array &queries,
+            tc::renderer::Map &renderer) const;
+
+    // handle compiled stat requests.
+    // identical queries (same type and name) are executed once per batch, result is reused for every request_id
+    json::Document HandleQueries(const tc::TransportCatalogue &catalog, const QueryPlan &plan,
+            tc::renderer::Map &renderer) const;
+
+    // convert stat requests into typed queries, requests of unknown type are skipped.
+    // plan refers to names in queries array and is valid while the array exists
+    QueryPlan CompileQueries(const json::Array &queries) const;
 
-    void HandleBusStopQuery(const tc::TransportCatalogue &catalog, const json::Node &query,
+    // convert one stat request, nullopt for unknown request type.
+    // query refers to name in request dict
+    static std::optional<StatQuery> CompileQuery(const json::Dict &query);
+    // tile of Map request: whole map if request has no tile keys,
+    // invalid tile if some of "zoom", "x", "y" is missed or is not integer
+    static tc::renderer::Viewport CompileViewport(const json::Dict &query);
+
+    // deduplication counters for all handled batches
+    DedupStats GetDedupStats() const;
+
+    // latency histogram of all handled queries of type
+    LatencyHistogram GetLatencyHistogram(QueryType type) const;
+
+    void HandleBusQuery(const tc::TransportCatalogue &catalog, const StatQuery &query, json::Builder &builder) const;
+
+    void HandleBusStopQuery(const tc::TransportCatalogue &catalog, const StatQuery &query,
             json::Builder &builder) const;
 
-    void HandleMapQuery(const tc::TransportCatalogue &catalog, const json::Node &query, tc::renderer::Map &renderer,
+    void HandleMapQuery(const tc::TransportCatalogue &catalog, const StatQuery &query, tc::renderer::Map &renderer,
+            json::Builder &builder) const;
+
+    // answer with statistics of handler: latency percentiles per query type, cache hit rates, catalog sizes
+    void HandleStatsQuery(const tc::TransportCatalogue &catalog, const StatQuery &query,
             json::Builder &builder) const;
 
     void RenderBusRoutesMap(const tc::TransportCatalogue &catalog, tc::renderer::Map &renderer,
             std::ostream &out) const;
+
+    // render only map objects visible in viewport, map layout is built once per catalog version
+    void RenderMapViewport(const tc::TransportCatalogue &catalog, const tc::renderer::Viewport &viewport,
+            tc::renderer::Map &renderer, std::ostream &out) const;
+
+private:
+    // map objects of catalog in rendering order
+    static tc::renderer::MapLayout BuildMapLayout(const tc::TransportCatalogue &catalog);
+    // set layout of catalog version to renderer if it is not set yet
+    static void EnsureMapLayout(const tc::TransportCatalogue &catalog, tc::renderer::Map &renderer);
+
+    // objects of map layer rendered by one task
+    struct MapChunk {
+        tc::renderer::Layer layer;
+        detail::IndexRange range;
+    };
+    // call render(i) for every chunk index, chunks are rendered concurrently by render pool threads
+    void ForEachMapChunk(size_t chunks_count, const std::function<void(size_t)> &render) const;
+    // render map from fragments of previous maps, only objects missed in renderer cache are rendered.
+    // fragments of all map objects are kept in renderer cache
+    void RenderMapFragments(tc::renderer::Map &renderer, const svg::PackedDocument &styles,
+            const std::vector<MapChunk> &chunks, size_t objects_count, std::ostream &out) const;
+    // write svg document with styles and fragments texts in order
+    static void WriteMapDocument(const svg::PackedDocument &styles,
+            const std::vector<tc::renderer::Fragment> &fragments, int precision, std::ostream &out);
+
+    // dispatch query by type
+    void HandleQuery(const tc::TransportCatalogue &catalog, const StatQuery &query, tc::renderer::Map &renderer,
+            json::Builder &builder) const;
+
+    size_t threads_;
+    // queries execution and map rendering pools, nullptr for one thread
+    std::unique_ptr<detail::ThreadPool> pool_;
+    std::unique_ptr<detail::ThreadPool> render_pool_;
+    // serializes Map queries of all batches, renderer keeps rendering state
+    mutable std::mutex renderer_mutex_;
+
+    mutable std::atomic<size_t> queries_count_ = 0;
+    mutable std::atomic<size_t> executed_count_ = 0;
+
+    mutable QueryStats query_stats_ { QUERY_TYPES_COUNT };
+    mutable std::atomic<size_t> map_cache_hits_ = 0;
+    mutable std::atomic<size_t> map_cache_misses_ = 0;
+    // map objects fragments reused from previous map and rendered again
+    mutable std::atomic<size_t> fragments_reused_ = 0;
+    mutable std::atomic<size_t> fragments_rendered_ = 0;
 };
 
 }
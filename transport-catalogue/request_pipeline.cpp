@@ -0,0 +1,112 @@
+/*
+ * request_pipeline.cpp
+ *
+ *  Staged parse -> execute -> serialize batch processing
+ */
+
+#include "request_pipeline.h"
+
+#include <exception>
+#include <thread>
+
+#include "parallel.h"
+
+namespace tc {
+
+namespace handler {
+
+// chunk of requests or answers passed between stages
+struct PipelineChunk {
+    json::Array nodes;
+    // the last chunk marker, sent after all data or after stage error
+    bool last = false;
+};
+
+using PipelineQueue = detail::SpscQueue<PipelineChunk>;
+
+Pipeline::Pipeline(const RequestHandler &handler, size_t chunk_size, size_t queue_capacity) :
+        handler_(handler), chunk_size_(std::max<size_t>(1, chunk_size)), queue_capacity_(
+                std::max<size_t>(1, queue_capacity)) {
+}
+
+void Pipeline::Run(const tc::TransportCatalogue &catalog, tc::renderer::Map &renderer,
+        std::string_view requests_text, std::ostream &output) const {
+
+    PipelineQueue requests(queue_capacity_);
+    PipelineQueue answers(queue_capacity_);
+    // the first error of every stage
+    std::exception_ptr parser_error;
+    std::exception_ptr executor_error;
+    std::exception_ptr serializer_error;
+
+    std::thread parser([&]() {
+        try {
+            const auto elements = json::SplitArray(requests_text);
+            for (size_t begin = 0; begin < elements.size(); begin += chunk_size_) {
+                size_t end = std::min(begin + chunk_size_, elements.size());
+                const char *text_begin = elements[begin].data();
+                const char *text_end = elements[end - 1].data() + elements[end - 1].size();
+                requests.Push( { json::LoadArrayElements(std::string_view(text_begin, text_end - text_begin)) });
+            }
+        } catch (...) {
+            parser_error = std::current_exception();
+        }
+        requests.Push( { { }, true });
+    });
+
+    std::thread executor([&]() {
+        // after error the stage drains its input, so previous stage is never blocked
+        for (auto chunk = requests.Pop(); !chunk.last; chunk = requests.Pop()) {
+            if (executor_error) {
+                continue;
+            }
+            try {
+                auto result = handler_.HandleQueries(catalog, chunk.nodes, renderer);
+                answers.Push( { std::move(result.GetRoot().AsArray()) });
+            } catch (...) {
+                executor_error = std::current_exception();
+            }
+        }
+        answers.Push( { { }, true });
+    });
+
+    std::thread serializer([&]() {
+        // the same layout as json::Print of answers array
+        json::PrintContext context { output };
+        bool first = true;
+        output << "[\n";
+        for (auto chunk = answers.Pop(); !chunk.last; chunk = answers.Pop()) {
+            if (serializer_error) {
+                continue;
+            }
+            try {
+                for (const auto &answer : chunk.nodes) {
+                    if (!first) {
+                        output << ",\n";
+                    }
+                    first = false;
+                    context.Indented().PrintIndent();
+                    json::PrintNode(answer, context.Indented());
+                }
+            } catch (...) {
+                serializer_error = std::current_exception();
+            }
+        }
+        output << "\n]";
+        output.flush();
+    });
+
+    parser.join();
+    executor.join();
+    serializer.join();
+
+    for (const auto &error : { parser_error, executor_error, serializer_error }) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+} // namespace handler
+
+} // namespace tc
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <iostream>
+#include <string_view>
+
+#include "json.h"
+#include "map_renderer.h"
+#include "request_handler.h"
+#include "transport_catalogue.h"
+
+namespace tc {
+
+namespace handler {
+
+/*
+ *  Pipeline - batch stat requests processing in three stages working concurrently:
+ *   parser thread     - parses chunks of stat_requests array text into json::Array,
+ *   executor thread   - answers chunks by RequestHandler (using its threads),
+ *   serializer thread - prints answers in original request order.
+ *  Stages are connected by bounded lock-free queues, fast stage waits for slow one.
+ *  Output is the same as json::Print of RequestHandler::HandleQueries result,
+ *  but identical queries are deduplicated inside chunk only.
+ */
+class Pipeline {
+public:
+    // chunk_size - number of requests in one chunk, queue_capacity - number of chunks in each queue
+    explicit Pipeline(const RequestHandler &handler, size_t chunk_size = 256, size_t queue_capacity = 16);
+
+    // process stat_requests array text and print answers array to output
+    void Run(const tc::TransportCatalogue &catalog, tc::renderer::Map &renderer, std::string_view requests_text,
+            std::ostream &output) const;
+
+private:
+    const RequestHandler &handler_;
+    size_t chunk_size_;
+    size_t queue_capacity_;
+};
+
+} // namespace handler
+
+} // namespace tc
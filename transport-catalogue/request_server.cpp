@@ -0,0 +1,211 @@
+/*
+ * request_server.cpp
+ *
+ *  Newline-delimited JSON stat requests server
+ */
+
+#include "request_server.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+using namespace std::literals;
+
+namespace tc {
+
+namespace handler {
+
+// size of socket read buffer
+const size_t READ_BUFFER_SIZE = 64 * 1024;
+// max size of request line, connection sending longer line is closed
+const size_t MAX_LINE_SIZE = 16 * 1024 * 1024;
+
+// write all data to socket, returns false if connection is broken
+bool WriteAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        auto written = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(written);
+    }
+    return true;
+}
+
+Server::Server(const tc::TransportCatalogue &catalog, tc::renderer::Map &renderer, const RequestHandler &handler) :
+        handler_([&catalog, &renderer, &handler](const json::Array &requests) {
+            return std::move(handler.HandleQueries(catalog, requests, renderer).GetRoot().AsArray());
+        }) {
+}
+
+Server::Server(BatchHandler handler) :
+        handler_(std::move(handler)) {
+}
+
+void Server::HandleLine(std::string_view line, std::string &output) const {
+    std::ostringstream out;
+    try {
+        std::istringstream input { std::string(line) };
+        json::Document request = json::Load(input);
+
+        if (request.GetRoot().IsArray()) {
+            json::PrintCompact(handler_(request.GetRoot().AsArray()), out);
+        } else {
+            json::Array answers = handler_(json::Array { request.GetRoot() });
+            if (answers.empty()) {
+                throw std::invalid_argument("unknown request type"s);
+            }
+            json::PrintCompact(answers.front(), out);
+        }
+    } catch (const std::exception &e) {
+        // request line is broken, but the connection is still alive
+        AppendError(e.what(), output);
+        return;
+    }
+    output += std::move(out).str();
+    output += '\n';
+}
+
+void Server::AppendError(std::string_view message, std::string &output) {
+    std::ostringstream out;
+    json::PrintCompact(json::Dict { { "error_message"s, std::string(message) } }, out);
+    output += std::move(out).str();
+    output += '\n';
+}
+
+void Server::Serve(std::istream &input, std::ostream &output) const {
+    std::string line;
+    std::string answers;
+    while (std::getline(input, line)) {
+        if (line.find_first_not_of(" \t\r"sv) == std::string::npos) {
+            continue;
+        }
+        HandleLine(line, answers);
+        // write answers when all received requests are handled
+        if (input.rdbuf()->in_avail() <= 0) {
+            output << answers;
+            output.flush();
+            answers.clear();
+        }
+    }
+    output << answers;
+    output.flush();
+}
+
+void Server::ServeConnection(int fd) const {
+    std::string input;
+    std::string answers;
+    char buffer[READ_BUFFER_SIZE];
+
+    while (true) {
+        auto received = read(fd, buffer, sizeof(buffer));
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            break;
+        }
+        input.append(buffer, received);
+
+        // handle all complete lines received so far
+        size_t start = 0;
+        for (size_t end = input.find('\n'); end != std::string::npos; end = input.find('\n', start)) {
+            auto line = std::string_view(input).substr(start, end - start);
+            if (line.find_first_not_of(" \t\r"sv) != std::string_view::npos) {
+                HandleLine(line, answers);
+            }
+            start = end + 1;
+        }
+        input.erase(0, start);
+
+        // incomplete line is too long, the client gets error answer and connection is closed
+        const bool overflow = input.size() > MAX_LINE_SIZE;
+        if (overflow) {
+            AppendError("request line is too long"sv, answers);
+        }
+        if (!WriteAll(fd, answers) || overflow) {
+            break;
+        }
+        answers.clear();
+    }
+    close(fd);
+}
+
+void Server::ServeUnixSocket(const std::string &path) const {
+    int listen_fd = ListenUnixSocket(path);
+    if (listen_fd < 0) {
+        return;
+    }
+    AcceptConnections(listen_fd);
+    close(listen_fd);
+}
+
+int Server::ListenUnixSocket(const std::string &path) {
+    sockaddr_un address { };
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "socket path is too long: "sv << path << std::endl;
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        std::cerr << "socket error: "sv << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    // remove stale socket file of previous run
+    unlink(path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+            || listen(listen_fd, SOMAXCONN) < 0) {
+        std::cerr << "socket bind error: "sv << std::strerror(errno) << std::endl;
+        close(listen_fd);
+        return -1;
+    }
+    return listen_fd;
+}
+
+void Server::AcceptConnections(int listen_fd) const {
+    while (true) {
+        {
+            // new connections wait in listen queue while all connection threads are busy
+            std::unique_lock lock(connections_mutex_);
+            connection_closed_.wait(lock, [this]() {
+                return connections_ < MAX_CONNECTIONS;
+            });
+        }
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            std::cerr << "socket accept error: "sv << std::strerror(errno) << std::endl;
+            break;
+        }
+        {
+            std::lock_guard lock(connections_mutex_);
+            ++connections_;
+        }
+        std::thread([this, fd]() {
+            ServeConnection(fd);
+            {
+                std::lock_guard lock(connections_mutex_);
+                --connections_;
+            }
+            connection_closed_.notify_one();
+        }).detach();
+    }
+}
+
+} // namespace handler
+
+} // namespace tc
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "json.h"
+#include "map_renderer.h"
+#include "request_handler.h"
+#include "transport_catalogue.h"
+
+namespace tc {
+
+namespace handler {
+
+/*
+ *  Server - long-running stat requests server over loaded catalog.
+ *
+ *  Protocol: newline-delimited JSON. Every input line is one stat request (JSON dict)
+ *  or a batch of stat requests (JSON array). Every input line gets exactly one output line
+ *  with answer dict or answers array, in the same order as requests.
+ *  Requests may be pipelined: answers for all complete lines already received are
+ *  written together, without waiting for the client.
+ *  Broken request line gets answer {"error_message": "..."}.
+ *  Socket connection is closed after error answer if request line is too long,
+ *  at most MAX_CONNECTIONS connections are served at once.
+ */
+class Server {
+public:
+    // max number of socket connections served at once, other clients wait in listen queue
+    static constexpr size_t MAX_CONNECTIONS = 64;
+
+    // answers array for stat requests array, requests of unknown type have no answer
+    using BatchHandler = std::function<json::Array(const json::Array&)>;
+
+    // requests are handled by handler over catalog
+    Server(const tc::TransportCatalogue &catalog, tc::renderer::Map &renderer, const RequestHandler &handler);
+    explicit Server(BatchHandler handler);
+
+    // serve requests from input until the end of input
+    void Serve(std::istream &input, std::ostream &output) const;
+
+    // listen on unix domain socket, every connection is served in separate thread.
+    // returns only on socket setup error
+    void ServeUnixSocket(const std::string &path) const;
+
+    // create listening unix domain socket, returns -1 on error
+    static int ListenUnixSocket(const std::string &path);
+    // accept connections of listening socket, every connection is served in separate thread.
+    // several processes may accept connections of the same socket.
+    // returns only on accept error, socket is not closed
+    void AcceptConnections(int listen_fd) const;
+
+private:
+    // answer one request line, the answer line is appended to output
+    void HandleLine(std::string_view line, std::string &output) const;
+    // append error answer line to output
+    static void AppendError(std::string_view message, std::string &output);
+    // serve one socket connection until it is closed
+    void ServeConnection(int fd) const;
+
+    BatchHandler handler_;
+    // number of served socket connections
+    mutable std::mutex connections_mutex_;
+    mutable std::condition_variable connection_closed_;
+    mutable size_t connections_ = 0;
+};
+
+} // namespace handler
+
+} // namespace tc
@@ -0,0 +1,185 @@
+/*
+ * request_workers.cpp
+ *
+ *  Worker processes sharing catalog image
+ */
+
+#include "request_workers.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <unordered_set>
+
+#include "json_builder.h"
+#include "request_handler.h"
+#include "request_server.h"
+
+using namespace std::literals;
+
+namespace tc {
+
+namespace handler {
+
+// set by SIGINT or SIGTERM in loader process
+static volatile std::sig_atomic_t stop_requested = 0;
+
+static void RequestStop(int) {
+    stop_requested = 1;
+}
+
+WorkerPool::WorkerPool(std::string_view image) :
+        shm_name_("/tc-catalogue-"s + std::to_string(getpid())) {
+    // loader mapping is not needed, segment stays alive until unlink
+    SharedMemory::Create(shm_name_, image);
+}
+
+WorkerPool::~WorkerPool() {
+    SharedMemory::Unlink(shm_name_);
+}
+
+int WorkerPool::Run(const std::string &socket_path, size_t workers) const {
+    int listen_fd = Server::ListenUnixSocket(socket_path);
+    if (listen_fd < 0) {
+        return 1;
+    }
+
+    // stop signal interrupts waiting for workers, workers are stopped and segment is removed
+    struct sigaction action { };
+    action.sa_handler = RequestStop;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    std::unordered_set<pid_t> running;
+    auto spawn = [this, listen_fd, &running]() {
+        pid_t pid = fork();
+        if (pid == 0) {
+            _exit(RunWorker(listen_fd));
+        }
+        if (pid < 0) {
+            std::cerr << "fork error: "sv << std::strerror(errno) << std::endl;
+            return;
+        }
+        running.insert(pid);
+    };
+    for (size_t i = 0; i < workers; ++i) {
+        spawn();
+    }
+
+    bool stopping = false;
+    while (!running.empty()) {
+        if (stop_requested && !stopping) {
+            stopping = true;
+            for (pid_t pid : running) {
+                kill(pid, SIGTERM);
+            }
+        }
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        running.erase(pid);
+        // crashed worker is replaced, worker finished by itself is not
+        if (WIFSIGNALED(status) && !stopping) {
+            std::cerr << "worker "sv << pid << " killed by signal "sv << WTERMSIG(status) << ", restarting"sv
+                    << std::endl;
+            spawn();
+        }
+    }
+    close(listen_fd);
+    return 0;
+}
+
+int WorkerPool::RunWorker(int listen_fd) const {
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+#ifdef __linux__
+    // worker is not left serving when loader process dies
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+    try {
+        auto memory = SharedMemory::Open(shm_name_);
+        CatalogueImage image(memory.GetData(), memory.GetSize());
+        // map is escaped once, answers share its text
+        std::optional<json::EscapedString> map;
+        if (auto text = image.GetMap()) {
+            map = json::EscapedString::Escape(*text);
+        }
+        Server server([&image, &map](const json::Array &requests) {
+            return HandleQueries(image, map, requests);
+        });
+        server.AcceptConnections(listen_fd);
+    } catch (const std::exception &e) {
+        std::cerr << "worker error: "sv << e.what() << std::endl;
+    }
+    return 1;
+}
+
+json::Array WorkerPool::HandleQueries(const CatalogueImage &image, const std::optional<json::EscapedString> &map,
+        const json::Array &requests) {
+    json::Builder builder;
+    builder.StartArray();
+    for (const auto &request : requests) {
+        auto query = RequestHandler::CompileQuery(request.AsDict());
+        if (!query) {
+            continue;
+        }
+        builder.StartDict().Key("request_id"s).Value(query->id);
+        switch (query->type) {
+        case QueryType::BUS:
+            if (auto bus = image.FindBus(query->name)) {
+                builder.Key("curvature"s).Value(bus->curvature);
+                builder.Key("route_length"s).Value(static_cast<int>(bus->length));
+                builder.Key("stop_count"s).Value(static_cast<int>(bus->stops));
+                builder.Key("unique_stop_count"s).Value(static_cast<int>(bus->unique_stops));
+            } else {
+                builder.Key("error_message"s).Value("not found"s);
+            }
+            break;
+        case QueryType::STOP:
+            if (auto buses = image.FindBusStop(query->name)) {
+                builder.Key("buses"s).StartArray();
+                for (auto bus_name : *buses) {
+                    builder.Value(std::string(bus_name));
+                }
+                builder.EndArray();
+            } else {
+                builder.Key("error_message"s).Value("not found"s);
+            }
+            break;
+        case QueryType::MAP:
+            // image keeps the whole map only, tiles are not rendered by workers
+            if (map && query->viewport.IsWholeMap()) {
+                builder.Key("map"s).Value(*map);
+            } else {
+                builder.Key("error_message"s).Value("not found"s);
+            }
+            break;
+        case QueryType::STATS:
+            builder.Key("catalogue"s).StartDict();
+            builder.Key("buses"s).Value(static_cast<int>(image.GetBusesCount()));
+            builder.Key("stops"s).Value(static_cast<int>(image.GetBusStopsCount()));
+            builder.Key("memory_kb"s).Value(static_cast<int>(image.GetSize() / 1024));
+            builder.EndDict();
+            break;
+        }
+        builder.EndDict();
+    }
+    builder.EndArray();
+    return std::move(builder.Build().AsArray());
+}
+
+} // namespace handler
+
+} // namespace tc
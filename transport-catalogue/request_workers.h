@@ -0,0 +1,50 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "catalogue_image.h"
+#include "json.h"
+
+namespace tc {
+
+namespace handler {
+
+/*
+ *  WorkerPool - worker processes serving stat requests from one catalog image in shared memory.
+ *
+ *  Catalog image (see CatalogueImage) is copied into POSIX shared memory segment once.
+ *  Every worker process maps the segment read-only and serves newline-delimited JSON requests
+ *  (see Server) from the same listening unix domain socket, so memory use does not grow with workers.
+ *  Worker killed by signal is restarted, other workers are not affected.
+ *  Workers answer Bus, Stop and Map requests from the image, Stats request gets image sizes.
+ */
+class WorkerPool {
+public:
+    // creates shared memory segment with image copy, throws std::runtime_error on failure
+    explicit WorkerPool(std::string_view image);
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    // removes shared memory segment
+    ~WorkerPool();
+
+    // fork workers serving unix domain socket, returns when all workers are finished.
+    // must be called from single-threaded process
+    int Run(const std::string &socket_path, size_t workers) const;
+
+    // answers to stat requests from catalog image, requests of unknown type have no answer.
+    // map - escaped map of image, nullopt if image has no map
+    static json::Array HandleQueries(const CatalogueImage &image, const std::optional<json::EscapedString> &map,
+            const json::Array &requests);
+
+private:
+    // worker process body, returns process exit code
+    int RunWorker(int listen_fd) const;
+
+    std::string shm_name_;
+};
+
+} // namespace handler
+
+} // namespace tc
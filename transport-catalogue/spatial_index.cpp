@@ -0,0 +1,106 @@
+/*
+ * spatial_index.cpp
+ *
+ *  Grid index of map objects for viewport culling
+ */
+
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace tc {
+
+namespace renderer {
+
+// limit of grid cells number
+const size_t MAX_GRID_CELLS = size_t(1) << 20;
+
+Rect Rect::Of(svg::Point lhs, svg::Point rhs) {
+    return {std::min(lhs.x, rhs.x), std::min(lhs.y, rhs.y), std::max(lhs.x, rhs.x), std::max(lhs.y, rhs.y)};
+}
+
+bool Rect::IntersectsSegment(svg::Point from, svg::Point to) const {
+    // Liang-Barsky clipping of segment from + t * (to - from), t in [0, 1]
+    const double dx = to.x - from.x;
+    const double dy = to.y - from.y;
+    double t_min = 0;
+    double t_max = 1;
+    auto clip = [&t_min, &t_max](double p, double q) {
+        if (p == 0) {
+            return q >= 0; // parallel to border, inside if on inner side
+        }
+        const double t = q / p;
+        if (p < 0) {
+            t_min = std::max(t_min, t);
+        } else {
+            t_max = std::min(t_max, t);
+        }
+        return t_min <= t_max;
+    };
+    return clip(-dx, from.x - min_x) && clip(dx, max_x - from.x) && clip(-dy, from.y - min_y)
+            && clip(dy, max_y - from.y);
+}
+
+GridIndex::GridIndex(const Rect &bounds, size_t items, size_t items_per_cell) :
+        bounds_(bounds) {
+    const size_t cells = std::clamp<size_t>(items / std::max<size_t>(1, items_per_cell), 1, MAX_GRID_CELLS);
+    // cells are close to squares
+    const double width = std::max(bounds.max_x - bounds.min_x, 1e-9);
+    const double height = std::max(bounds.max_y - bounds.min_y, 1e-9);
+    columns_ = std::clamp<size_t>(std::lround(std::sqrt(cells * width / height)), 1, cells);
+    rows_ = std::max<size_t>(1, cells / columns_);
+    cell_width_ = width / columns_;
+    cell_height_ = height / rows_;
+    cells_.assign(columns_ * rows_, { });
+}
+
+std::pair<size_t, size_t> GridIndex::ColumnRange(double min_x, double max_x) const {
+    auto column = [this](double x) {
+        return std::clamp<double>(std::floor((x - bounds_.min_x) / cell_width_), 0, columns_ - 1);
+    };
+    return {static_cast<size_t>(column(min_x)), static_cast<size_t>(column(max_x))};
+}
+
+std::pair<size_t, size_t> GridIndex::RowRange(double min_y, double max_y) const {
+    auto row = [this](double y) {
+        return std::clamp<double>(std::floor((y - bounds_.min_y) / cell_height_), 0, rows_ - 1);
+    };
+    return {static_cast<size_t>(row(min_y)), static_cast<size_t>(row(max_y))};
+}
+
+void GridIndex::Insert(uint32_t id, const Rect &box) {
+    const auto [first_column, last_column] = ColumnRange(box.min_x, box.max_x);
+    const auto [first_row, last_row] = RowRange(box.min_y, box.max_y);
+    for (size_t row = first_row; row <= last_row; ++row) {
+        for (size_t column = first_column; column <= last_column; ++column) {
+            auto &cell = cells_[row * columns_ + column];
+            // ids are ascending, so the same item is already the last one of cell
+            if (cell.empty() || cell.back() != id) {
+                cell.push_back(id);
+            }
+        }
+    }
+}
+
+std::vector<uint32_t> GridIndex::Query(const Rect &rect) const {
+    std::vector<uint32_t> result;
+    if (!bounds_.Intersects(rect)) {
+        return result;
+    }
+    const auto [first_column, last_column] = ColumnRange(rect.min_x, rect.max_x);
+    const auto [first_row, last_row] = RowRange(rect.min_y, rect.max_y);
+    for (size_t row = first_row; row <= last_row; ++row) {
+        for (size_t column = first_column; column <= last_column; ++column) {
+            const auto &cell = cells_[row * columns_ + column];
+            result.insert(result.end(), cell.begin(), cell.end());
+        }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+} // namespace renderer
+
+} // namespace tc
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "svg.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace tc {
+
+namespace renderer {
+
+// Rect - axis aligned rectangle in svg coordinates
+struct Rect {
+    double min_x = 0;
+    double min_y = 0;
+    double max_x = 0;
+    double max_y = 0;
+
+    // bounding box of two points
+    static Rect Of(svg::Point lhs, svg::Point rhs);
+
+    bool Intersects(const Rect &other) const {
+        return min_x <= other.max_x && other.min_x <= max_x && min_y <= other.max_y && other.min_y <= max_y;
+    }
+
+    // true if segment [from, to] crosses rectangle
+    bool IntersectsSegment(svg::Point from, svg::Point to) const;
+
+    Rect Expanded(double margin) const {
+        return {min_x - margin, min_y - margin, max_x + margin, max_y + margin};
+    }
+};
+
+/*
+ *  GridIndex - uniform grid over bounding boxes of items.
+ *  Item id is stored in every cell its box overlaps, so query cost is
+ *  proportional to number of visited cells and found items, not to total items number.
+ */
+class GridIndex {
+public:
+    GridIndex() = default;
+    // grid over bounds with about items_per_cell items in a cell for items evenly spread
+    GridIndex(const Rect &bounds, size_t items, size_t items_per_cell = 4);
+
+    // ids must be inserted in ascending order
+    void Insert(uint32_t id, const Rect &box);
+
+    // ids of items which boxes may intersect rect, sorted and unique
+    std::vector<uint32_t> Query(const Rect &rect) const;
+
+private:
+    // [first, last] cells range of coordinates
+    std::pair<size_t, size_t> ColumnRange(double min_x, double max_x) const;
+    std::pair<size_t, size_t> RowRange(double min_y, double max_y) const;
+
+    Rect bounds_;
+    size_t columns_ = 1;
+    size_t rows_ = 1;
+    double cell_width_ = 1;
+    double cell_height_ = 1;
+    std::vector<std::vector<uint32_t>> cells_ = std::vector<std::vector<uint32_t>>(1);
+};
+
+} // namespace renderer
+
+} // namespace tc
@@ -1,5 +1,6 @@
 #include <string_view>
-#include <iomanip>
+#include <charconv>
+#include <vector>
 
 #include "stat_reader.h"
 
@@ -8,8 +9,39 @@
 namespace tc {
 
 namespace reader {
+
+using namespace std::string_view_literals;
+
+// number of queries lines read and answered at once
+const size_t QUERIES_BATCH_SIZE = 64 * 1024;
+// minimal number of queries processed by one task
+const size_t MIN_QUERIES_CHUNK = 256;
+// number of tasks per thread for load balancing
+const size_t CHUNKS_PER_THREAD = 4;
+
+// append number in the default stream format with precision 6 (as printf "%.6g")
+static void AppendNumber(std::string &out, double value) {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::general, 6);
+    out.append(buffer, result.ptr);
+}
+
+static void AppendNumber(std::string &out, size_t value) {
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+Stat::Stat(size_t threads) :
+        threads_(std::max<size_t>(1, threads)) {
+    if (threads_ > 1) {
+        // caller thread is a worker too
+        pool_ = std::make_unique<detail::ThreadPool>(threads_ - 1);
+    }
+}
+
 // read queries from stream , process it and output results
-void Stat::operator ()(std::istream &in, std::ostream &out, TransportCatalogue &catalog) {
+void Stat::operator ()(std::istream &in, std::ostream &out, const TransportCatalogue &catalog) {
     // read queries number
     int records;
     in >> records;
@@ -17,18 +49,60 @@ void Stat::operator ()(std::istream &in, std::ostream &out, TransportCatalogue &
     std::string line;
     std::getline(in, line); // eat endl after records
 
-    for (int i = 0; i < records; ++i) {
-        std::getline(in, line);
-        if (auto pos = line.find("Bus "); pos == 0) {
+    std::string buffer;
+    std::vector<size_t> ends;
+    std::vector<std::string_view> lines;
+    std::string answers;
+    for (int processed = 0; processed < records;) {
+        // read batch of lines into one buffer
+        buffer.clear();
+        ends.clear();
+        for (; processed < records && ends.size() < QUERIES_BATCH_SIZE; ++processed) {
+            std::getline(in, line);
+            buffer += line;
+            ends.push_back(buffer.size());
+        }
+        lines.clear();
+        for (size_t i = 0, begin = 0; i < ends.size(); begin = ends[i++]) {
+            lines.push_back(std::string_view(buffer).substr(begin, ends[i] - begin));
+        }
+
+        // every range is answered into own buffer, buffers are written in queries order.
+        // without pool all lines are answered in caller thread
+        const auto ranges = detail::SplitRange(lines.size(), pool_ ? threads_ * CHUNKS_PER_THREAD : 1,
+                MIN_QUERIES_CHUNK);
+        if (ranges.size() == 1) {
+            answers.clear();
+            ProcessQueries(lines, ranges.front(), answers, catalog);
+            out.write(answers.data(), answers.size());
+            continue;
+        }
+        auto chunks = detail::ParallelMap(ranges, [this, &lines, &catalog](size_t begin, size_t end) {
+            std::string chunk;
+            ProcessQueries(lines, { begin, end }, chunk, catalog);
+            return chunk;
+        }, pool_.get());
+        for (const auto &chunk : chunks) {
+            out.write(chunk.data(), chunk.size());
+        }
+    }
+    out.flush();
+}
+
+void Stat::ProcessQueries(const std::vector<std::string_view> &lines, detail::IndexRange range, std::string &out,
+        const TransportCatalogue &catalog) const {
+    for (size_t i = range.first; i < range.second; ++i) {
+        auto line = lines[i];
+        if (line.substr(0, 4) == "Bus "sv) {
             // process BusQuery
             ProcessBusQuery(line, out, catalog);
-        } else if (auto pos = line.find("Stop "); pos == 0) {
+        } else if (line.substr(0, 5) == "Stop "sv) {
             ProcessBusStopQuery(line, out, catalog);
         }
     }
 }
 
-void Stat::ProcessBusQuery(const std::string &line, std::ostream &out, TransportCatalogue &catalog) {
+void Stat::ProcessBusQuery(std::string_view line, std::string &out, const TransportCatalogue &catalog) const {
     // parse bus query line
     std::string_view name(line);
     name.remove_prefix(4); // "Bus ";
@@ -36,24 +110,28 @@ void Stat::ProcessBusQuery(const std::string &line, std::ostream &out, Transport
     name = detail::trimSpaces(name);
     // process bus query by transport catalog
     auto result = catalog.ProcessBusQuery(name);
-    out << "Bus " << result.name << ":";
+    out += "Bus "sv;
+    out += result.name;
+    out += ':';
     // if request result exists
     if (result.valid) {
-        // remember old stream  output precision
-        const auto default_precision { out.precision() };
-
-        out << " " << result.stops << " stops on route, " << result.unique_stops << " unique stops, "
-                << std::setprecision(6) << result.length << " route length, " << result.curvature << " curvature";
-        // restore default stream precision
-        out << std::setprecision(default_precision);
+        out += ' ';
+        AppendNumber(out, result.stops);
+        out += " stops on route, "sv;
+        AppendNumber(out, result.unique_stops);
+        out += " unique stops, "sv;
+        AppendNumber(out, result.length);
+        out += " route length, "sv;
+        AppendNumber(out, result.curvature);
+        out += " curvature"sv;
     } else {
-        out << " not found";
+        out += " not found"sv;
     }
 
-    out << std::endl;
+    out += '\n';
 }
 
-void Stat::ProcessBusStopQuery(const std::string &line, std::ostream &out, TransportCatalogue &catalog) {
+void Stat::ProcessBusStopQuery(std::string_view line, std::string &out, const TransportCatalogue &catalog) const {
     // parse bus stop query
     std::string_view name(line);
     name.remove_prefix(5); // "Stop ";
@@ -61,22 +139,25 @@ void Stat::ProcessBusStopQuery(const std::string &line, std::ostream &out, Trans
     // process query on transport catalog
     auto result = catalog.ProcessBusStopQuery(name);
 
-    out << "Stop " << result.name << ":";
+    out += "Stop "sv;
+    out += result.name;
+    out += ':';
     // if result exists
     if (result.valid) {
         // if there are not buses through bus stop
         if (result.buses_names.size() == 0) {
-            out << " no buses";
+            out += " no buses"sv;
         } else { // we have buses
-            out << " buses";
+            out += " buses"sv;
             for (auto bus : result.buses_names) {
-                out << " " << bus;
+                out += ' ';
+                out += bus;
             }
         }
     } else { // no busStop
-        out << " not found";
+        out += " not found"sv;
     }
-    out << std::endl;
+    out += '\n';
 }
 
 } // namespace reader
@@ -1,8 +1,12 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
+#include "parallel.h"
 #include "transport_catalogue.h"
 
 namespace tc {
@@ -11,13 +15,23 @@ namespace reader {
 
 class Stat {
 public:
-    // read queries from stream , process it and output results
-    void operator()(std::istream &in, std::ostream &out, TransportCatalogue &catalog);
+    // threads - number of threads processing queries, caller thread included
+    explicit Stat(size_t threads = 1);
+
+    // read queries from stream , process it and output results.
+    // answers are written in queries order
+    void operator()(std::istream &in, std::ostream &out, const TransportCatalogue &catalog);
 private:
+    // process queries lines of range, answers are appended to out
+    void ProcessQueries(const std::vector<std::string_view> &lines, detail::IndexRange range, std::string &out,
+            const TransportCatalogue &catalog) const;
+
+    void ProcessBusQuery(std::string_view line, std::string &out, const TransportCatalogue &catalog) const;
 
-    void ProcessBusQuery(const std::string &line, std::ostream &out, TransportCatalogue &catalog);
+    void ProcessBusStopQuery(std::string_view line, std::string &out, const TransportCatalogue &catalog) const;
 
-    void ProcessBusStopQuery(const std::string &line, std::ostream &out, TransportCatalogue &catalog);
+    size_t threads_;
+    std::unique_ptr<detail::ThreadPool> pool_;
 };
 
 } //namespace reader
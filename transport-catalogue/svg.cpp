@@ -1,47 +1,106 @@
 #include "svg.h"
+#include <algorithm>
+#include <charconv>
 #include <exception>
 
 namespace svg {
 
 using namespace std::literals;
 
+// ---------- Writer ------------------
+
+Writer& Writer::operator<<(double value) {
+    char buffer[32];
+    // general format with precision matches std::ostream default format
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::general, precision_);
+    buffer_.append(buffer, result.ptr);
+    return *this;
+}
+
+Writer& Writer::operator<<(int value) {
+    char buffer[16];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    buffer_.append(buffer, result.ptr);
+    return *this;
+}
+
+Writer& Writer::operator<<(uint32_t value) {
+    char buffer[16];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    buffer_.append(buffer, result.ptr);
+    return *this;
+}
+
+Writer& Writer::WriteFixed(int64_t value, int decimals) {
+    if (value < 0) {
+        buffer_ += '-';
+    }
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value < 0 ? -static_cast<uint64_t>(value) : value);
+    const std::string_view text(digits, result.ptr - digits);
+    const size_t fraction_size = decimals;
+    if (text.size() > fraction_size) {
+        buffer_ += text.substr(0, text.size() - fraction_size);
+    } else {
+        buffer_ += '0';
+    }
+    // дробная часть дополняется нулями слева, нули справа отбрасываются
+    std::string_view fraction = text.substr(text.size() > fraction_size ? text.size() - fraction_size : 0);
+    size_t leading_zeros = fraction_size - fraction.size();
+    while (!fraction.empty() && fraction.back() == '0') {
+        fraction.remove_suffix(1);
+    }
+    if (!fraction.empty()) {
+        buffer_ += '.';
+        buffer_.append(leading_zeros, '0');
+        buffer_ += fraction;
+    }
+    return *this;
+}
+
 void Object::Render(const RenderContext &context) const {
     context.RenderIndent();
 
     // Делегируем вывод тега своим подклассам
     RenderObject(context);
 
-    context.out << std::endl;
+    context.out << '\n';
 }
 
-std::ostream& operator<<(std::ostream &os, StrokeLineCap cap) {
-    using namespace std::literals;
+std::string_view ToString(StrokeLineCap cap) {
     switch (cap) {
     case StrokeLineCap::BUTT:
-        return os << "butt"sv;
+        return "butt"sv;
     case StrokeLineCap::ROUND:
-        return os << "round"sv;
+        return "round"sv;
     case StrokeLineCap::SQUARE:
-        return os << "square"sv;
+        return "square"sv;
     }
-    return os;
+    return {};
 }
 
-std::ostream& operator<<(std::ostream &os, StrokeLineJoin join) {
-    using namespace std::literals;
+std::ostream& operator<<(std::ostream &os, StrokeLineCap cap) {
+    return os << ToString(cap);
+}
+
+std::string_view ToString(StrokeLineJoin join) {
     switch (join) {
     case StrokeLineJoin::ARCS:
-        return os << "arcs"sv;
+        return "arcs"sv;
     case StrokeLineJoin::BEVEL:
-        return os << "bevel"sv;
+        return "bevel"sv;
     case StrokeLineJoin::MITER:
-        return os << "miter"sv;
+        return "miter"sv;
     case StrokeLineJoin::MITER_CLIP:
-        return os << "miter-clip"sv;
+        return "miter-clip"sv;
     case StrokeLineJoin::ROUND:
-        return os << "round"sv;
+        return "round"sv;
     }
-    return os;
+    return {};
+}
+
+std::ostream& operator<<(std::ostream &os, StrokeLineJoin join) {
+    return os << ToString(join);
 }
 
 // ---------- Circle ------------------
@@ -57,39 +116,48 @@ Circle& Circle::SetRadius(double radius) {
 }
 
 void Circle::RenderObject(const RenderContext &context) const {
-    auto &out = context.out;
-    out << "<circle";
-    out << " cx=\""sv << center_.x << "\" cy=\""sv << center_.y << "\" "sv;
+    RenderCircle(context.out, center_);
+}
+
+void Circle::RenderCircle(Writer &out, Point center) const {
+    out << "<circle"sv;
+    out << " cx=\""sv << center.x << "\" cy=\""sv << center.y << "\" "sv;
     out << "r=\""sv << radius_ << "\""sv;
     RenderAttrs(out);
     out << "/>"sv;
 }
 
+void Circle::RenderStyle(Writer &out) const {
+    RenderStyleProps(out);
+}
+
 Polyline& Polyline::AddPoint(Point point) {
     points_.emplace_back(std::move(point));
     return *this;
 }
 
 void Polyline::RenderObject(const RenderContext &context) const {
-    auto &out = context.out;
-    out << "<polyline";
+    RenderPoints(context.out, points_.data(), points_.data() + points_.size());
+}
+
+void Polyline::RenderPoints(Writer &out, const Point *begin, const Point *end) const {
+    out << "<polyline"sv;
     out << " points=\""sv;
-    {
-        bool first = true;
-        for (const auto &point : points_) {
-            if (first) {
-                first = false;
-            } else {
-                out << " ";
-            }
-            out << point.x << "," << point.y;
+    for (const Point *point = begin; point != end; ++point) {
+        if (point != begin) {
+            out << ' ';
         }
+        out << point->x << ',' << point->y;
     }
     out << "\""sv;
     RenderAttrs(out);
     out << "/>"sv;
 }
 
+void Polyline::RenderStyle(Writer &out) const {
+    RenderStyleProps(out);
+}
+
 Text& Text::SetPosition(Point pos) {
     position_ = pos;
     return *this;
@@ -121,21 +189,28 @@ Text& Text::SetData(std::string data) {
 }
 
 void Text::RenderObject(const RenderContext &context) const {
-    auto &out = context.out;
-    out << "<text";
+    RenderText(context.out, position_, data_);
+}
+
+void Text::RenderText(Writer &out, Point position, std::string_view data) const {
+    out << "<text"sv;
     RenderAttrs(out);
-    out << " x=\""sv << position_.x << "\" y=\"" << position_.y << "\"";
-    out << " dx=\""sv << offset_.x << "\" dy=\"" << offset_.y << "\"";
-    out << " font-size=\""sv << font_size_ << "\"";
+    out << " x=\""sv << position.x << "\" y=\""sv << position.y << '"';
+    out << " dx=\""sv << offset_.x << "\" dy=\""sv << offset_.y << '"';
+    out << " font-size=\""sv << font_size_ << '"';
     if (font_family_.size()) {
-        out << " font-family=\""sv << font_family_ << "\"";
+        out << " font-family=\""sv << font_family_ << '"';
     }
     if (font_weight_.size()) {
-        out << " font-weight=\""sv << font_weight_ << "\"";
+        out << " font-weight=\""sv << font_weight_ << '"';
     }
     out << ">"sv;
-    // print data here
-    for (const auto ch : data_) {
+    RenderData(out, data);
+    out << "</text>"sv;
+}
+
+void Text::RenderData(Writer &out, std::string_view data) const {
+    for (const auto ch : data) {
         // screening special chars if required
         if (auto search = scr::spec_chars.find(ch); search != std::string_view::npos) {
             out << GetScreenSeq(ch);
@@ -143,7 +218,17 @@ void Text::RenderObject(const RenderContext &context) const {
             out << ch;
         }
     }
-    out << "</text>"sv;
+}
+
+void Text::RenderStyle(Writer &out) const {
+    RenderStyleProps(out);
+    out << "font-size:"sv << font_size_ << "px;"sv;
+    if (font_family_.size()) {
+        out << "font-family:"sv << font_family_ << ';';
+    }
+    if (font_weight_.size()) {
+        out << "font-weight:"sv << font_weight_ << ';';
+    }
 }
 
 const std::string_view Text::GetScreenSeq(char ch) const {
@@ -164,19 +249,224 @@ const std::string_view Text::GetScreenSeq(char ch) const {
     return {};
 }
 
+void RenderDocumentBegin(Writer &out) {
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv;
+    out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv;
+}
+
+void RenderDocumentEnd(Writer &out) {
+    out << "</svg>"sv;
+}
+
 void Document::AddPtr(std::unique_ptr<Object> &&obj) {
     objects_.emplace_back(std::move(obj));
 }
 
-void Document::Render(std::ostream &out) const {
+void Document::Render(std::ostream &out, int precision) const {
+    Writer writer(precision);
+    Render(writer);
+    out.write(writer.GetBuffer().data(), writer.GetBuffer().size());
+}
+
+void Document::Render(Writer &out) const {
     RenderContext ctx(out, 2, 2);
-    out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>"sv << std::endl;
-    out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">"sv << std::endl;
+    RenderDocumentBegin(out);
     for (const auto &ptr : objects_) {
         ptr->Render(ctx);
     }
-    out << "</svg>"sv;
+    RenderDocumentEnd(out);
+}
 
+// ---------- PackedDocument ------------------
+
+PackedDocument::StyleId PackedDocument::AddCircleStyle(Circle style) {
+    circle_styles_.push_back(std::move(style));
+    return circle_styles_.size() - 1;
+}
+
+PackedDocument::StyleId PackedDocument::AddPolylineStyle(Polyline style) {
+    polyline_styles_.push_back(std::move(style));
+    return polyline_styles_.size() - 1;
+}
+
+PackedDocument::StyleId PackedDocument::AddTextStyle(Text style) {
+    text_styles_.push_back(std::move(style));
+    return text_styles_.size() - 1;
+}
+
+void PackedDocument::AddCircle(StyleId style, Point center) {
+    elements_.push_back( { Kind::CIRCLE, static_cast<uint32_t>(circles_.size()) });
+    circles_.push_back( { style, center });
+}
+
+void PackedDocument::AddPolyline(StyleId style) {
+    elements_.push_back( { Kind::POLYLINE, static_cast<uint32_t>(polylines_.size()) });
+    const auto begin = static_cast<uint32_t>(points_.size());
+    polylines_.push_back( { style, begin, begin });
+}
+
+void PackedDocument::AddPoint(Point point) {
+    points_.push_back(point);
+    polylines_.back().points_end = points_.size();
+}
+
+void PackedDocument::AddText(StyleId style, Point position, std::string_view data) {
+    elements_.push_back( { Kind::TEXT, static_cast<uint32_t>(texts_.size()) });
+    texts_.push_back( { style, position, static_cast<uint32_t>(chars_.size()), static_cast<uint32_t>(data.size()) });
+    chars_ += data;
+}
+
+void PackedDocument::SetCompact(int decimals) {
+    compact_decimals_ = std::clamp(decimals, 0, MAX_COMPACT_DECIMALS);
+    compact_scale_ = std::pow(10.0, *compact_decimals_);
+}
+
+void PackedDocument::Reserve(size_t circles, size_t polylines, size_t texts, size_t points, size_t chars) {
+    elements_.reserve(elements_.size() + circles + polylines + texts);
+    circles_.reserve(circles_.size() + circles);
+    polylines_.reserve(polylines_.size() + polylines);
+    texts_.reserve(texts_.size() + texts);
+    points_.reserve(points_.size() + points);
+    chars_.reserve(chars_.size() + chars);
+}
+
+void PackedDocument::Render(std::ostream &out, int precision) const {
+    Writer writer(precision);
+    Render(writer);
+    out.write(writer.GetBuffer().data(), writer.GetBuffer().size());
+}
+
+void PackedDocument::Render(Writer &out) const {
+    RenderDocumentBegin(out);
+    RenderStyles(out);
+    RenderElements(out);
+    RenderDocumentEnd(out);
+}
+
+void PackedDocument::RenderElements(Writer &out) const {
+    RenderElements(out, 0, elements_.size());
+}
+
+void PackedDocument::RenderElements(Writer &out, size_t begin, size_t end) const {
+    RenderContext ctx(out, 2, 2);
+    for (size_t i = begin; i < end; ++i) {
+        const auto &element = elements_[i];
+        ctx.RenderIndent();
+        if (compact_decimals_) {
+            RenderCompactElement(out, element);
+            out << '\n';
+            continue;
+        }
+        switch (element.kind) {
+        case Kind::CIRCLE: {
+            const auto &circle = circles_[element.index];
+            circle_styles_[circle.style].RenderCircle(out, circle.center);
+            break;
+        }
+        case Kind::POLYLINE: {
+            const auto &polyline = polylines_[element.index];
+            polyline_styles_[polyline.style].RenderPoints(out, points_.data() + polyline.points_begin,
+                    points_.data() + polyline.points_end);
+            break;
+        }
+        case Kind::TEXT: {
+            const auto &text = texts_[element.index];
+            text_styles_[text.style].RenderText(out, text.position,
+                    std::string_view(chars_).substr(text.data_begin, text.data_size));
+            break;
+        }
+        }
+        out << '\n';
+    }
+}
+
+void PackedDocument::RenderStyles(Writer &out) const {
+    if (!compact_decimals_) {
+        return;
+    }
+    // классы стилей: c - круги, l - ломаные, t - тексты, номер - номер стиля
+    out << "  <style>"sv;
+    for (size_t i = 0; i < circle_styles_.size(); ++i) {
+        out << ".c"sv << static_cast<uint32_t>(i) << '{';
+        circle_styles_[i].RenderStyle(out);
+        out << '}';
+    }
+    for (size_t i = 0; i < polyline_styles_.size(); ++i) {
+        out << ".l"sv << static_cast<uint32_t>(i) << '{';
+        polyline_styles_[i].RenderStyle(out);
+        out << '}';
+    }
+    for (size_t i = 0; i < text_styles_.size(); ++i) {
+        out << ".t"sv << static_cast<uint32_t>(i) << '{';
+        text_styles_[i].RenderStyle(out);
+        out << '}';
+    }
+    out << "</style>\n"sv;
+}
+
+int64_t PackedDocument::ToFixed(double value) const {
+    return std::llround(value * compact_scale_);
+}
+
+void PackedDocument::RenderCompactElement(Writer &out, const Element &element) const {
+    const int decimals = *compact_decimals_;
+    // числа пути разделяются пробелом, если следующее число не начинается со знака минус
+    auto write_number = [&out, decimals](int64_t value, bool separate) {
+        if (separate && value >= 0) {
+            out << ' ';
+        }
+        out.WriteFixed(value, decimals);
+    };
+
+    switch (element.kind) {
+    case Kind::CIRCLE: {
+        const auto &circle = circles_[element.index];
+        out << "<circle class=\"c"sv << circle.style << "\" cx=\""sv;
+        out.WriteFixed(ToFixed(circle.center.x), decimals) << "\" cy=\""sv;
+        out.WriteFixed(ToFixed(circle.center.y), decimals) << "\" r=\""sv;
+        out.WriteFixed(ToFixed(circle_styles_[circle.style].radius_), decimals) << "\"/>"sv;
+        break;
+    }
+    case Kind::POLYLINE: {
+        // первая вершина - абсолютная, остальные - смещения от предыдущей округлённой вершины,
+        // поэтому ошибка округления не накапливается
+        const auto &polyline = polylines_[element.index];
+        out << "<path class=\"l"sv << polyline.style << "\" d=\""sv;
+        int64_t x = 0;
+        int64_t y = 0;
+        for (uint32_t i = polyline.points_begin; i < polyline.points_end; ++i) {
+            const int64_t next_x = ToFixed(points_[i].x);
+            const int64_t next_y = ToFixed(points_[i].y);
+            if (i == polyline.points_begin) {
+                out << 'M';
+                write_number(next_x, false);
+                write_number(next_y, true);
+            } else {
+                if (i == polyline.points_begin + 1) {
+                    out << 'l';
+                }
+                write_number(next_x - x, i != polyline.points_begin + 1);
+                write_number(next_y - y, true);
+            }
+            x = next_x;
+            y = next_y;
+        }
+        out << "\"/>"sv;
+        break;
+    }
+    case Kind::TEXT: {
+        const auto &text = texts_[element.index];
+        const auto &style = text_styles_[text.style];
+        out << "<text class=\"t"sv << text.style << "\" x=\""sv;
+        out.WriteFixed(ToFixed(text.position.x), decimals) << "\" y=\""sv;
+        out.WriteFixed(ToFixed(text.position.y), decimals) << "\" dx=\""sv;
+        out.WriteFixed(ToFixed(style.offset_.x), decimals) << "\" dy=\""sv;
+        out.WriteFixed(ToFixed(style.offset_.y), decimals) << "\">"sv;
+        style.RenderData(out, std::string_view(chars_).substr(text.data_begin, text.data_size));
+        out << "</text>"sv;
+        break;
+    }
+    }
 }
 
 Polyline CreateStar(Point center, double outer_rad, double inner_rad, int num_rays) {
@@ -235,6 +525,20 @@ void Star::Draw(ObjectContainer &obj_container) const {
 
 } //namespace shapes
 
+Writer& operator <<(Writer &out, const svg::Color &c) {
+    if (std::holds_alternative<std::monostate>(c)) {
+        out << "none"sv;
+    } else if (const auto *color_ptr = std::get_if<std::string>(&c)) {
+        out << *color_ptr;
+    } else if (const auto *rgb_ptr = std::get_if<svg::Rgb>(&c)) {
+        out << "rgb("sv << int(rgb_ptr->red) << ',' << int(rgb_ptr->green) << ',' << int(rgb_ptr->blue) << ')';
+    } else if (const auto *rgba_ptr = std::get_if<svg::Rgba>(&c)) {
+        out << "rgba("sv << int(rgba_ptr->red) << ',' << int(rgba_ptr->green) << ',' << int(rgba_ptr->blue) << ',';
+        out << rgba_ptr->opacity << ')';
+    }
+    return out;
+}
+
 std::ostream& operator <<(std::ostream &os, const svg::Color &c) {
     // std::get_if вернёт указатель на значение нужного типа
     // либо nullptr, если variant содержит значение другого типа.
@@ -34,16 +34,66 @@ struct Point {
     double y = 0;
 };
 
+/*
+ * Writer - буфер вывода SVG-документа.
+ * Текст дописывается в конец буфера, числа форматируются std::to_chars
+ * с заданной точностью (как std::ostream с precision по умолчанию)
+ */
+class Writer {
+public:
+    static constexpr int DEFAULT_PRECISION = 6;
+
+    explicit Writer(int precision = DEFAULT_PRECISION) :
+            precision_(precision) {
+    }
+
+    Writer& operator<<(std::string_view text) {
+        buffer_ += text;
+        return *this;
+    }
+    Writer& operator<<(const std::string &text) {
+        buffer_ += text;
+        return *this;
+    }
+    Writer& operator<<(char ch) {
+        buffer_ += ch;
+        return *this;
+    }
+    Writer& operator<<(double value);
+    Writer& operator<<(int value);
+    Writer& operator<<(uint32_t value);
+    // выводит число value / 10^decimals в десятичной записи без лишних нулей дробной части
+    Writer& WriteFixed(int64_t value, int decimals);
+
+    void Reserve(size_t size) {
+        buffer_.reserve(size);
+    }
+    int GetPrecision() const {
+        return precision_;
+    }
+    const std::string& GetBuffer() const {
+        return buffer_;
+    }
+    // забирает накопленный текст, буфер становится пустым
+    std::string Release() {
+        return std::move(buffer_);
+    }
+
+private:
+    std::string buffer_;
+    int precision_;
+};
+
 /*
  * Вспомогательная структура, хранящая контекст для вывода SVG-документа с отступами.
- * Хранит ссылку на поток вывода, текущее значение и шаг отступа при выводе элемента
+ * Хранит ссылку на буфер вывода, текущее значение и шаг отступа при выводе элемента
  */
 struct RenderContext {
-    RenderContext(std::ostream &out) :
+    RenderContext(Writer &out) :
             out(out) {
     }
 
-    RenderContext(std::ostream &out, int indent_step, int indent = 0) :
+    RenderContext(Writer &out, int indent_step, int indent = 0) :
             out(out), indent_step(indent_step), indent(indent) {
     }
 
@@ -52,16 +102,23 @@ struct RenderContext {
     }
 
     void RenderIndent() const {
-        for (int i = 0; i < indent; ++i) {
-            out.put(' ');
+        static const std::string_view spaces = "                                ";
+        for (int rest = indent; rest > 0; rest -= spaces.size()) {
+            out << spaces.substr(0, rest);
         }
     }
 
-    std::ostream &out;
+    Writer &out;
     int indent_step = 0;
     int indent = 0;
 };
 
+class PackedDocument;
+
+// заголовок и окончание svg-документа
+void RenderDocumentBegin(Writer &out);
+void RenderDocumentEnd(Writer &out);
+
 /*
  * Абстрактный базовый класс Object служит для унифицированного хранения
  * конкретных тегов SVG-документа
@@ -122,6 +179,7 @@ struct Rgba {
 using Color = std::variant<std::monostate, std::string, svg::Rgb, svg::Rgba>;
 
 std::ostream& operator<<(std::ostream &os, const Color &c);
+Writer& operator<<(Writer &out, const Color &c);
 
 inline const Color NoneColor;
 //------------------------------------------------
@@ -130,12 +188,14 @@ enum class StrokeLineCap {
     BUTT, ROUND, SQUARE,
 };
 
+std::string_view ToString(StrokeLineCap cap);
 std::ostream& operator<<(std::ostream &os, StrokeLineCap cap);
 
 enum class StrokeLineJoin {
     ARCS, BEVEL, MITER, MITER_CLIP, ROUND,
 };
 
+std::string_view ToString(StrokeLineJoin join);
 std::ostream& operator<<(std::ostream &os, StrokeLineJoin join);
 
 template<typename Owner>
@@ -143,29 +203,87 @@ class PathProps {
 public:
     Owner& SetFillColor(Color color) {
         fill_color_ = std::move(color);
+        frozen_attrs_.reset();
         return AsOwner();
     }
     Owner& SetStrokeColor(Color color) {
         stroke_color_ = std::move(color);
+        frozen_attrs_.reset();
         return AsOwner();
     }
     Owner& SetStrokeWidth(double width) {
         stroke_width_ = width;
+        frozen_attrs_.reset();
         return AsOwner();
     }
     Owner& SetStrokeLineCap(StrokeLineCap line_cap) {
         stroke_linecap_ = line_cap;
+        frozen_attrs_.reset();
         return AsOwner();
     }
     Owner& SetStrokeLineJoin(StrokeLineJoin line_join) {
         stroke_linejoin_ = line_join;
+        frozen_attrs_.reset();
+        return AsOwner();
+    }
+    // Порядок отрисовки заливки и обводки, например "stroke" - обводка под заливкой
+    Owner& SetPaintOrder(std::string paint_order) {
+        paint_order_ = std::move(paint_order);
+        frozen_attrs_.reset();
+        return AsOwner();
+    }
+
+    // Форматирует атрибуты один раз, копии объекта используют готовый текст атрибутов.
+    // Используется для стилей, общих для многих объектов
+    Owner& FreezeAttrs(int precision = Writer::DEFAULT_PRECISION) {
+        Writer attrs(precision);
+        FormatAttrs(attrs);
+        frozen_attrs_ = std::make_shared<const FrozenAttrs>(FrozenAttrs { attrs.Release(), precision });
         return AsOwner();
     }
 
 protected:
     ~PathProps() = default;
 
-    void RenderAttrs(std::ostream &out) const {
+    void RenderAttrs(Writer &out) const {
+        if (frozen_attrs_ && frozen_attrs_->precision == out.GetPrecision()) {
+            out << frozen_attrs_->text;
+        } else {
+            FormatAttrs(out);
+        }
+    }
+
+    // выводит атрибуты как свойства CSS
+    void RenderStyleProps(Writer &out) const {
+        using namespace std::literals;
+
+        if (fill_color_) {
+            out << "fill:"sv << *fill_color_ << ';';
+        }
+        if (stroke_color_) {
+            out << "stroke:"sv << *stroke_color_ << ';';
+        }
+        if (stroke_width_) {
+            out << "stroke-width:"sv << *stroke_width_ << "px;"sv;
+        }
+        if (stroke_linecap_) {
+            out << "stroke-linecap:"sv << ToString(*stroke_linecap_) << ';';
+        }
+        if (stroke_linejoin_) {
+            out << "stroke-linejoin:"sv << ToString(*stroke_linejoin_) << ';';
+        }
+        if (paint_order_) {
+            out << "paint-order:"sv << *paint_order_ << ';';
+        }
+    }
+
+private:
+    struct FrozenAttrs {
+        std::string text;
+        int precision;
+    };
+
+    void FormatAttrs(Writer &out) const {
         using namespace std::literals;
 
         if (fill_color_) {
@@ -178,14 +296,16 @@ protected:
             out << " stroke-width=\""sv << *stroke_width_ << "\""sv;
         }
         if (stroke_linecap_) {
-            out << " stroke-linecap=\""sv << *stroke_linecap_ << "\""sv;
+            out << " stroke-linecap=\""sv << ToString(*stroke_linecap_) << "\""sv;
         }
         if (stroke_linejoin_) {
-            out << " stroke-linejoin=\""sv << *stroke_linejoin_ << "\""sv;
+            out << " stroke-linejoin=\""sv << ToString(*stroke_linejoin_) << "\""sv;
+        }
+        if (paint_order_) {
+            out << " paint-order=\""sv << *paint_order_ << "\""sv;
         }
     }
 
-private:
     Owner& AsOwner() {
         // static_cast безопасно преобразует *this к Owner&,
         // если класс Owner — наследник PathProps
@@ -197,6 +317,8 @@ private:
     std::optional<double> stroke_width_;
     std::optional<StrokeLineCap> stroke_linecap_;
     std::optional<StrokeLineJoin> stroke_linejoin_;
+    std::optional<std::string> paint_order_;
+    std::shared_ptr<const FrozenAttrs> frozen_attrs_;
 };
 
 /*
@@ -209,7 +331,14 @@ public:
     Circle& SetRadius(double radius);
 
 private:
+    friend class PackedDocument;
+
     void RenderObject(const RenderContext &context) const override;
+    // выводит круг с атрибутами объекта в заданной точке
+    void RenderCircle(Writer &out, Point center) const;
+    // выводит атрибуты как свойства CSS. Радиус остаётся атрибутом каждого круга:
+    // свойство CSS r есть только в SVG 2
+    void RenderStyle(Writer &out) const;
 
     Point center_;
     double radius_ = 1.0;
@@ -225,7 +354,13 @@ public:
     Polyline& AddPoint(Point point);
 
 private:
+    friend class PackedDocument;
+
     void RenderObject(const RenderContext &context) const override;
+    // выводит ломаную с атрибутами объекта по вершинам [begin, end)
+    void RenderPoints(Writer &out, const Point *begin, const Point *end) const;
+    // выводит атрибуты как свойства CSS
+    void RenderStyle(Writer &out) const;
 
 private:
     std::vector<Point> points_;
@@ -264,7 +399,15 @@ private:
     std::string font_weight_;
     std::string data_;
 private:
+    friend class PackedDocument;
+
     void RenderObject(const RenderContext &context) const override;
+    // выводит текст с атрибутами объекта в заданной точке
+    void RenderText(Writer &out, Point position, std::string_view data) const;
+    // выводит атрибуты и шрифт как свойства CSS
+    void RenderStyle(Writer &out) const;
+    // выводит содержимое тега с экранированием спецсимволов
+    void RenderData(Writer &out, std::string_view data) const;
     const std::string_view GetScreenSeq(char ch) const;
 };
 
@@ -274,10 +417,109 @@ public:
     // Добавляет в svg-документ объект-наследник svg::Object
     void AddPtr(std::unique_ptr<Object> &&obj) override;
 
-    // Выводит в ostream svg-представление документа
-    void Render(std::ostream &out) const;
+    // Выводит в ostream svg-представление документа, весь текст выводится одной записью
+    void Render(std::ostream &out, int precision = Writer::DEFAULT_PRECISION) const;
+
+    // Дописывает svg-представление документа в буфер
+    void Render(Writer &out) const;
 
 };
+/*
+ * PackedDocument - svg-документ с компактным хранением элементов.
+ * Элементы хранятся в типизированных векторах, вершины ломаных и тексты - в общих буферах,
+ * оформление элементов задаётся общими стилями (объектами-прототипами).
+ * Добавление элемента не выделяет память, кроме роста векторов,
+ * вывод не использует виртуальные вызовы
+ */
+class PackedDocument {
+public:
+    using StyleId = uint32_t;
+    // больше знаков после запятой не нужно для экрана, а координаты в единицах 10^-decimals не переполняют int64
+    static constexpr int MAX_COMPACT_DECIMALS = 6;
+
+    // Стили: атрибуты прототипа используются всеми элементами стиля.
+    // Для круга используется радиус прототипа, для текста - смещение и шрифт прототипа
+    StyleId AddCircleStyle(Circle style);
+    StyleId AddPolylineStyle(Polyline style);
+    StyleId AddTextStyle(Text style);
+
+    void AddCircle(StyleId style, Point center);
+    // начинает ломаную, вершины добавляются AddPoint
+    void AddPolyline(StyleId style);
+    // добавляет вершину к последней ломаной
+    void AddPoint(Point point);
+    void AddText(StyleId style, Point position, std::string_view data);
+
+    // Компактный вывод: атрибуты стилей выводятся один раз блоком <style> как классы CSS,
+    // ломаные выводятся элементами <path> с относительными координатами,
+    // все координаты округляются до decimals знаков после запятой, decimals ограничивается [0, MAX_COMPACT_DECIMALS]
+    void SetCompact(int decimals);
+
+    // резервирует память под ещё circles кругов, polylines ломаных, texts текстов,
+    // points вершин ломаных и chars символов текстов
+    void Reserve(size_t circles, size_t polylines, size_t texts, size_t points, size_t chars);
+    size_t Size() const {
+        return elements_.size();
+    }
+
+    // Выводит в ostream svg-представление документа, весь текст выводится одной записью
+    void Render(std::ostream &out, int precision = Writer::DEFAULT_PRECISION) const;
+    // Дописывает svg-представление документа в буфер
+    void Render(Writer &out) const;
+    // Дописывает в буфер только элементы документа, без заголовка и окончания.
+    // Документ можно собрать из элементов нескольких частей:
+    // RenderDocumentBegin, RenderElements частей, RenderDocumentEnd
+    void RenderElements(Writer &out) const;
+    // Дописывает в буфер элементы с номерами [begin, end)
+    void RenderElements(Writer &out, size_t begin, size_t end) const;
+    // Дописывает в буфер блок <style> со стилями для компактного вывода, выводится после заголовка
+    void RenderStyles(Writer &out) const;
+
+private:
+    enum class Kind : uint8_t {
+        CIRCLE, POLYLINE, TEXT
+    };
+    struct Element {
+        Kind kind;
+        uint32_t index; // в векторе элементов своего типа
+    };
+    struct CircleRecord {
+        StyleId style;
+        Point center;
+    };
+    struct PolylineRecord {
+        StyleId style;
+        uint32_t points_begin;
+        uint32_t points_end;
+    };
+    struct TextRecord {
+        StyleId style;
+        Point position;
+        uint32_t data_begin;
+        uint32_t data_size;
+    };
+
+    std::vector<Circle> circle_styles_;
+    std::vector<Polyline> polyline_styles_;
+    std::vector<Text> text_styles_;
+
+    std::vector<Element> elements_;
+    std::vector<CircleRecord> circles_;
+    std::vector<PolylineRecord> polylines_;
+    std::vector<TextRecord> texts_;
+    std::vector<Point> points_;
+    std::string chars_;
+
+    // выводит элемент в компактном виде
+    void RenderCompactElement(Writer &out, const Element &element) const;
+    // координата в единицах 10^-decimals
+    int64_t ToFixed(double value) const;
+
+    // число знаков после запятой компактного вывода
+    std::optional<int> compact_decimals_;
+    double compact_scale_ = 1;
+};
+
 /*
  * Интерфейс Drawable имеет метод Draw позволяющий нарисовать себя в ObjectContainer-е
  * */
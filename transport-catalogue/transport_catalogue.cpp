@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <atomic>
 #include <numeric>
 #include <cassert>
 #include "transport_catalogue.h"
@@ -128,6 +129,47 @@ detail::RouteLengthResult Bus::GetLength(const TransportCatalogue &calc) const {
     return {length, length / geoLength};;
 }
 
+// source of unique data versions for all catalogs
+static std::atomic<uint64_t> last_version { 0 };
+
+TransportCatalogue::TransportCatalogue() :
+        version_(++last_version) {
+}
+
+void TransportCatalogue::UpdateVersion() {
+    version_ = ++last_version;
+}
+
+// heap memory of string, short strings are stored inline
+static size_t StringMemory(const std::string &str) {
+    return str.capacity() > std::string().capacity() ? str.capacity() + 1 : 0;
+}
+
+// hash map memory: buckets array and nodes with value, next pointer and cached hash
+template<typename HashMap>
+static size_t HashMapMemory(const HashMap &map) {
+    return map.bucket_count() * sizeof(void*) + map.size() * (sizeof(typename HashMap::value_type) + 2 * sizeof(void*));
+}
+
+size_t TransportCatalogue::GetMemoryUsage() const {
+    size_t result = bus_stops_.size() * sizeof(BusStop) + buses_.size() * sizeof(Bus);
+    for (const auto &bus_stop : bus_stops_) {
+        result += StringMemory(bus_stop.getName());
+    }
+    for (const auto &bus : buses_) {
+        result += StringMemory(bus.GetName()) + bus.GetBusStops().capacity() * sizeof(const BusStop*);
+    }
+
+    result += HashMapMemory(buses_by_name_) + HashMapMemory(bus_stops_by_name_) + HashMapMemory(segment_distances_);
+    result += HashMapMemory(idx_bus_stops_to_buses);
+    for (const auto& [_, buses] : idx_bus_stops_to_buses) {
+        result += buses.capacity() * sizeof(Bus*);
+    }
+    // tree node: value, three pointers and color
+    result += idx_bus_name_to_bus_.size() * (sizeof(decltype(idx_bus_name_to_bus_)::value_type) + 4 * sizeof(void*));
+    return result;
+}
+
 detail::BusQueryResult TransportCatalogue::ProcessBusQuery(const std::string_view name) const {
 
     auto bus = GetBus(name);
@@ -169,7 +211,7 @@ detail::BusStopQueryResult TransportCatalogue::ProcessBusStopQuery(const std::st
 }
 
 void TransportCatalogue::AddBus(Bus &&bus) {
-    buses_.push_back(bus);
+    buses_.push_back(std::move(bus));
     UpdateBusesIndexesByBackBus();
 }
 
@@ -181,6 +223,7 @@ void TransportCatalogue::AddBus(const Bus &bus) {
 
 void TransportCatalogue::UpdateBusesIndexesByBackBus() {
 
+    UpdateVersion();
     auto bus_ptr = &buses_.back();
     buses_by_name_[buses_.back().GetName()] = bus_ptr;
     idx_bus_name_to_bus_[buses_.back().GetName()] = bus_ptr;
@@ -192,7 +235,7 @@ void TransportCatalogue::UpdateBusesIndexesByBackBus() {
 
 void TransportCatalogue::AddBusStop(BusStop &&busStop) {
 
-    bus_stops_.push_back(busStop);
+    bus_stops_.push_back(std::move(busStop));
     UpdateBusStopIndexesByBackBusStop();
 }
 
@@ -225,6 +268,7 @@ void TransportCatalogue::SetSegmentDistance(const std::string_view stop1_name, c
     assert(stop1 != nullptr);
 
     segment_distances_[ { stop1->getName(), stop2->getName() }] = distance;
+    UpdateVersion();
 }
 
 std::vector<geo::Coordinates> TransportCatalogue::GetAllBusStopsCoordinates() const {
@@ -246,6 +290,7 @@ std::vector<geo::Coordinates> TransportCatalogue::GetAllBusStopsCoordinates() co
 }
 
 void TransportCatalogue::UpdateBusStopIndexesByBackBusStop() {
+    UpdateVersion();
 
     bus_stops_by_name_[bus_stops_.back().getName()] = &bus_stops_.back();
 }
@@ -283,12 +328,22 @@ void Bus::PrintBusStops(const TransportCatalogue &calc, std::ostream &os) const
 
 std::vector<geo::Coordinates> TransportCatalogue::GetBusStopsCoordinates(const std::string_view bus_name) const {
     std::vector<geo::Coordinates> result;
+    const auto stops = GetBusRouteStops(bus_name);
+    result.reserve(stops.size());
+    for (const auto stop : stops) {
+        result.push_back(stop->getCoordinates());
+    }
+    return result;
+}
+
+BusStops TransportCatalogue::GetBusRouteStops(const std::string_view bus_name) const {
+    BusStops result;
     if (auto search = buses_by_name_.find(bus_name); search != buses_by_name_.end()) {
         const tc::Bus &bus = *(search->second);
         result.reserve(bus.GetBusStopsNumber());
         // add all stops in forward direction
         for (const auto &stop : bus.GetBusStops()) {
-            result.push_back(stop->getCoordinates());
+            result.push_back(stop);
         }
 
         if (bus.GetType() == tc::BusType::LINEAR) {
@@ -296,7 +351,7 @@ std::vector<geo::Coordinates> TransportCatalogue::GetBusStopsCoordinates(const s
             // if linear - we need to add all stops from finish to start
             auto it = bus.GetBusStops().rbegin();
             for (++it; it != bus.GetBusStops().rend(); ++it) {
-                result.push_back((*it)->getCoordinates());
+                result.push_back(*it);
             }
         }
 
@@ -317,20 +372,42 @@ std::vector<std::string_view> TransportCatalogue::GetSortedBusNames() const {
     return result;
 }
 
+std::vector<std::string_view> TransportCatalogue::GetSortedBusStopNames() const {
+
+    std::vector<std::string_view> result;
+    result.reserve(bus_stops_by_name_.size());
+
+    for (const auto& [name, _] : bus_stops_by_name_) {
+        result.emplace_back(name);
+    }
+    std::sort(result.begin(), result.end());
+
+    return result;
+}
+
 std::vector<geo::Coordinates> TransportCatalogue::GetBusStopsForName(const std::string_view name) const {
 
     std::vector<geo::Coordinates> result;
+    for (const auto stop : GetBusTerminals(name)) {
+        result.push_back(stop->getCoordinates());
+    }
+
+    return result;
+}
+
+BusStops TransportCatalogue::GetBusTerminals(const std::string_view name) const {
+
+    BusStops result;
 
     const auto &bus = *GetBus(name);
-    result.reserve(bus.GetBusStopsNumber());
 
     if (bus.GetBusStopsNumber() > 0) {
-        const auto &first_bus_stop = *(*bus.GetBusStops().begin());
-        result.push_back(first_bus_stop.getCoordinates());
+        const auto *first_bus_stop = *bus.GetBusStops().begin();
+        result.push_back(first_bus_stop);
         if (bus.GetType() == tc::BusType::LINEAR) {
-            const auto &last_bus_stop = *(*bus.GetBusStops().rbegin());
-            if (first_bus_stop.getName() != last_bus_stop.getName()) {
-                result.push_back(last_bus_stop.getCoordinates());
+            const auto *last_bus_stop = *bus.GetBusStops().rbegin();
+            if (first_bus_stop->getName() != last_bus_stop->getName()) {
+                result.push_back(last_bus_stop);
             }
         }
     }
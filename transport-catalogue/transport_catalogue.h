@@ -8,6 +8,7 @@
 #include <unordered_map>
 #include <string_view>
 #include <map>
+#include <cstdint>
 
 #include "geo.h"
 
@@ -133,7 +134,11 @@ class TransportCatalogue {
     std::map<std::string_view, const Bus*> idx_bus_name_to_bus_;
 
     MapSegmentDistances segment_distances_;
+
+    // data version, unique across all catalogs, changed on every update
+    uint64_t version_;
 public:
+    TransportCatalogue();
 
     void AddBus(Bus &&bus);
 
@@ -147,6 +152,22 @@ public:
 
     const BusStop* GetBusStop(const std::string_view name) const;
 
+    // returns data version. Version is changed by every update, so cached results must be recalculated
+    uint64_t GetVersion() const {
+        return version_;
+    }
+
+    size_t GetBusesCount() const {
+        return buses_.size();
+    }
+
+    size_t GetBusStopsCount() const {
+        return bus_stops_.size();
+    }
+
+    // approximate heap memory used by catalog data and indexes, bytes
+    size_t GetMemoryUsage() const;
+
     // returns result on bus request
     detail::BusQueryResult ProcessBusQuery(const std::string_view name) const;
 
@@ -166,16 +187,28 @@ public:
     // if BusType::LINEAR - returned bus stops points for both directions
     std::vector<geo::Coordinates> GetBusStopsCoordinates(const std::string_view bus_name) const;
 
+    // returns bus stops of bus line in route order.
+    // if BusType::LINEAR - returned bus stops for both directions
+    BusStops GetBusRouteStops(const std::string_view bus_name) const;
+
     // returns bus names vector sorted by name
     std::vector<std::string_view> GetSortedBusNames() const;
 
+    // returns names of all bus stops sorted by name
+    std::vector<std::string_view> GetSortedBusStopNames() const;
+
     // returns vector of pairs  bus stops name and position , sorted by name
     std::vector<std::pair<std::string_view, geo::Coordinates>> GetAllBusStopsNamesAndCoordinatesSortedByName() const;
 
     // return bus stops positions for bus rendering
     std::vector<geo::Coordinates> GetBusStopsForName(const std::string_view name) const;
 
+    // return bus stops where bus name is rendered: first stop and last stop of linear bus if it differs
+    BusStops GetBusTerminals(const std::string_view name) const;
+
 private:
+    // set new data version after update
+    void UpdateVersion();
 // update indexes after pushBACK new bus in dequeue
     void UpdateBusesIndexesByBackBus();
     // update indexes after pushBACK new bus stop in dequeue